@@ -0,0 +1,187 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Distributions of the ads generated by the sources of the Yahoo! Streaming
+ *  Benchmark
+ *
+ *  - uniform: the ads are cycled round-robin as in the original benchmark;
+ *  - zipf:[s]: the ad of rank k (starting from the first ad of the first
+ *    campaign) has probability proportional to 1/k^s;
+ *  - hot:[frac]:[prob]: the first frac of the ads receives prob of the events,
+ *    the rest is uniform.
+ *  Zipf is sampled in constant time with the rejection-inversion method of
+ *  Hoermann and Derflinger, so it works with millions of ads.
+ */
+
+#ifndef AD_DISTRIBUTION_H
+#define AD_DISTRIBUTION_H
+
+// include
+#include <cmath>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+
+using namespace std;
+
+// Distribution of the ads over the events
+struct AdDistribution
+{
+    enum kind_t { UNIFORM, ZIPF, HOT };
+
+    kind_t kind;
+    double skew; // exponent of the zipf distribution
+    double hot_fraction; // fraction of hot ads
+    double hot_prob; // probability of the hot ads
+
+    // constructor
+    AdDistribution(): kind(UNIFORM), skew(0), hot_fraction(0), hot_prob(0) {}
+};
+
+// parse a distribution "uniform", "zipf:[s]" or "hot:[frac]:[prob]" (returns false if not valid)
+static inline bool parse_ad_distribution(const string &spec, AdDistribution &dist)
+{
+    dist = AdDistribution();
+    stringstream ss(spec);
+    string kind, p1, p2;
+    getline(ss, kind, ':');
+    getline(ss, p1, ':');
+    getline(ss, p2, ':');
+    if (kind == "uniform")
+        return p1.empty();
+    else if (kind == "zipf") {
+        dist.kind = AdDistribution::ZIPF;
+        dist.skew = atof(p1.c_str());
+        return dist.skew > 0;
+    }
+    else if (kind == "hot") {
+        dist.kind = AdDistribution::HOT;
+        dist.hot_fraction = atof(p1.c_str());
+        dist.hot_prob = atof(p2.c_str());
+        return dist.hot_fraction > 0 && dist.hot_fraction < 1 && dist.hot_prob >= 0 && dist.hot_prob <= 1;
+    }
+    return false;
+}
+
+// get the description of a distribution
+static inline string ad_distribution_name(const AdDistribution &dist)
+{
+    stringstream ss;
+    switch (dist.kind) {
+        case AdDistribution::ZIPF: ss << "zipf:" << dist.skew; break;
+        case AdDistribution::HOT: ss << "hot:" << dist.hot_fraction << ":" << dist.hot_prob; break;
+        default: ss << "uniform";
+    }
+    return ss.str();
+}
+
+// Generator of the ad indexes of a source
+class AdSampler
+{
+private:
+    AdDistribution dist;
+    size_t num_ads;
+    size_t hot_ads; // number of hot ads (hot distribution)
+    uint64_t state; // state of the random generator
+    uint64_t value; // position in the round-robin cycle
+    double h_x1, h_n, s; // constants of the rejection-inversion (zipf distribution)
+
+    // next random number (splitmix64)
+    inline uint64_t next_random()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // next random number in [0, 1)
+    inline double next_double()
+    {
+        return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // log(1 + x) / x and (exp(x) - 1) / x, accurate also close to zero
+    static double helper1(double x)
+    {
+        return (fabs(x) > 1e-8) ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3.0));
+    }
+
+    static double helper2(double x)
+    {
+        return (fabs(x) > 1e-8) ? expm1(x) / x : 1 + x * 0.5 * (1 + x * (1.0 / 3.0));
+    }
+
+    // density h(x) = 1/x^skew, its integral H and the inverse of H
+    double h(double x) const
+    {
+        return exp(-dist.skew * log(x));
+    }
+
+    double h_integral(double x) const
+    {
+        double log_x = log(x);
+        return helper2((1 - dist.skew) * log_x) * log_x;
+    }
+
+    double h_integral_inverse(double x) const
+    {
+        double t = x * (1 - dist.skew);
+        if (t < -1)
+            t = -1; // limit the value because of rounding errors
+        return exp(helper1(t) * x);
+    }
+
+public:
+    // constructor
+    AdSampler(const AdDistribution &_dist, size_t _num_ads, uint64_t _seed):
+              dist(_dist), num_ads(_num_ads), state(_seed * 0x2545F4914F6CDD1Dull + 1), value(0)
+    {
+        hot_ads = (size_t) (dist.hot_fraction * num_ads);
+        hot_ads = (hot_ads == 0) ? 1 : hot_ads;
+        if (dist.kind == AdDistribution::ZIPF) {
+            h_x1 = h_integral(1.5) - 1;
+            h_n = h_integral(num_ads + 0.5);
+            s = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+        }
+    }
+
+    // get the index of the next ad
+    inline size_t next()
+    {
+        switch (dist.kind) {
+            case AdDistribution::ZIPF:
+                while (true) {
+                    double u = h_n + next_double() * (h_x1 - h_n);
+                    double x = h_integral_inverse(u);
+                    size_t k = (size_t) (x + 0.5);
+                    k = (k < 1) ? 1 : ((k > num_ads) ? num_ads : k);
+                    if (k - x <= s || u >= h_integral(k + 0.5) - h(k))
+                        return k - 1;
+                }
+            case AdDistribution::HOT:
+                if (hot_ads >= num_ads || next_double() < dist.hot_prob)
+                    return next_random() % hot_ads;
+                return hot_ads + next_random() % (num_ads - hot_ads);
+            default:
+                return (value++) % num_ads;
+        }
+    }
+};
+
+#endif
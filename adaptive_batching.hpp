@@ -0,0 +1,143 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Adaptive batch sizing of the batched sources
+ *
+ *  A batch is flushed when it is full or when it spans half the target latency
+ *  (flush deadline), so batching never delays an event by more than that. The
+ *  length of the next batch follows the feedback of the chain: the age of the
+ *  first event of the last batch consumed by the filter or the join, and the
+ *  queue depth, i.e. the batches emitted by the source and not yet consumed.
+ *  Longer batches amortize the per-batch costs, so the length grows while the
+ *  age is well within the target and shrinks when the target is exceeded. A
+ *  growing queue means that the chain cannot keep up with the source, and the
+ *  length is doubled since shorter batches would only make the backlog worse.
+ *  Batches flushed by the deadline cap the length, since longer ones could
+ *  not be filled in time.
+ */
+
+#ifndef ADAPTIVE_BATCHING_H
+#define ADAPTIVE_BATCHING_H
+
+// include
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+// Controller of the batch length of a source
+class AdaptiveBatcher
+{
+private:
+    static const size_t MIN_LEN = 1; // minimum batch length
+    static const size_t MAX_LEN = 8192; // maximum batch length
+    static const long HIGH_DEPTH = 4; // queue depth above which batches grow
+
+    uint64_t target; // target latency (usec)
+    uint64_t deadline; // maximum time spanned by a batch (usec)
+    size_t len; // length of the next batch
+    long emitted; // batches emitted by the source
+    std::atomic<long> consumed; // batches consumed downstream
+    std::atomic<uint64_t> last_age; // age of the first event of the last consumed batch (usec)
+    vector<pair<size_t, size_t>> trace; // events and batches emitted in each second
+
+    // bound a length between MIN_LEN and MAX_LEN
+    static inline size_t clamp_len(size_t l)
+    {
+        return (l < MIN_LEN) ? MIN_LEN : ((l > MAX_LEN) ? MAX_LEN : l);
+    }
+
+public:
+    // constructor
+    AdaptiveBatcher(uint64_t target_latency_usec, size_t initial_len=1):
+                    target(target_latency_usec), deadline(std::max<uint64_t>(target_latency_usec / 2, 1)),
+                    len(clamp_len(initial_len)), emitted(0), consumed(0), last_age(0) {}
+
+    // get the length of the next batch
+    size_t nextLength() const
+    {
+        return len;
+    }
+
+    // get the flush deadline (usec)
+    uint64_t flushDeadline() const
+    {
+        return deadline;
+    }
+
+    // account an emitted batch of n events spanning from first_ts to last_ts and adapt the length
+    void emit(size_t n, uint64_t first_ts, uint64_t last_ts)
+    {
+        size_t sec = last_ts / 1000000;
+        if (trace.size() <= sec)
+            trace.resize(sec + 1, make_pair(0, 0));
+        trace[sec].first += n;
+        trace[sec].second++;
+        long depth = ++emitted - consumed.load(std::memory_order_relaxed);
+        uint64_t age = last_age.load(std::memory_order_relaxed);
+        if (depth > HIGH_DEPTH)
+            len = clamp_len(2 * len);
+        else if (age > target)
+            len = clamp_len(len - len / 4);
+        else if (age < target / 2)
+            len = clamp_len(len + len / 8 + 1);
+        if (last_ts - first_ts >= deadline)
+            len = std::min(len, clamp_len(n));
+    }
+
+    // account a batch consumed downstream whose first event is age usec old (called by the filter or the join)
+    inline void consume(uint64_t age)
+    {
+        last_age.store(age, std::memory_order_relaxed);
+        consumed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // get the events and batches emitted in each second
+    const vector<pair<size_t, size_t>> &history() const
+    {
+        return trace;
+    }
+};
+
+/**
+ *  \brief Function to print the batch lengths chosen over time
+ *
+ *  This function prints the average length of the batches emitted by all the
+ *  adaptive sources in each second of the execution.
+ */
+static inline void print_batch_lengths(const vector<AdaptiveBatcher *> &batchers)
+{
+    vector<pair<size_t, size_t>> total;
+    for (auto b: batchers) {
+        auto &h = b->history();
+        if (total.size() < h.size())
+            total.resize(h.size(), make_pair(0, 0));
+        for (size_t s=0; s<h.size(); s++) {
+            total[s].first += h[s].first;
+            total[s].second += h[s].second;
+        }
+    }
+    cout << "[Main] Adaptive batch length per second:";
+    for (auto &t: total)
+        cout << " " << ((t.second > 0) ? t.first / t.second : 0);
+    cout << endl;
+}
+
+#endif
@@ -0,0 +1,130 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Counter of the heap allocations of the Yahoo! Streaming Benchmark
+ *
+ *  Compiling with -DYSB_COUNT_ALLOCS replaces the global operator new by one
+ *  counting the calls in per-thread slots (each in its own cache line), so the
+ *  allocations done on the data path can be compared across configurations.
+ *  The replacement affects every allocation of the program, so it is off by
+ *  default (and total() returns zero). The slabs of the pools are allocated
+ *  with malloc, so they are not counted here (see poolSlabs in
+ *  ysb_allocator.hpp), and the drivers report them next to the count of the
+ *  calls of operator new. This file replaces the global
+ *  operators, hence it must be included by a single translation unit. The
+ *  operators are not inlined, otherwise the compiler would see the memory of
+ *  a new released by free.
+ */
+
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+// include
+#include <new>
+#include <atomic>
+#include <cstdlib>
+
+using namespace std;
+
+#if defined(YSB_COUNT_ALLOCS)
+
+// Per-thread counters of the heap allocations
+class AllocCounter
+{
+private:
+    static const size_t SLOTS = 256; // slots shared by the threads beyond SLOTS
+
+    // counter of a thread
+    struct alignas(64) slot_t
+    {
+        std::atomic<long> count;
+    };
+
+    static slot_t *slots()
+    {
+        static slot_t counters[SLOTS];
+        return counters;
+    }
+
+public:
+    static const bool enabled = true;
+
+    // count an allocation of the calling thread
+    static inline void add()
+    {
+        static std::atomic<size_t> next_slot(0);
+        static thread_local size_t my_slot = next_slot.fetch_add(1, std::memory_order_relaxed) % SLOTS;
+        slots()[my_slot].count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // get the number of allocations of all the threads
+    static long total()
+    {
+        long sum = 0;
+        for (size_t i=0; i<SLOTS; i++)
+            sum += slots()[i].count.load(std::memory_order_relaxed);
+        return sum;
+    }
+};
+
+// counting replacement of the global operator new
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    AllocCounter::add();
+    void *ptr = malloc((size > 0) ? size : 1);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+// replacement of the global operator delete
+__attribute__((noinline)) void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+// counting replacement of the global operator new[]
+__attribute__((noinline)) void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+// replacement of the global operator delete[]
+__attribute__((noinline)) void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+#else
+
+// Counters of the heap allocations (disabled)
+class AllocCounter
+{
+public:
+    static const bool enabled = false;
+
+    static inline void add() {}
+
+    static long total()
+    {
+        return 0;
+    }
+};
+
+#endif
+
+#endif
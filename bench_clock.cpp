@@ -0,0 +1,77 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Microbenchmark of the timestamp service of the Yahoo! Streaming Benchmark
+ *
+ *  Every clock mode supported by the machine is started in turn and the cost
+ *  of now_usecs() is measured by a single thread over the given number of
+ *  calls, next to the cost of clock_gettime(). The program prints the ns per
+ *  call of each mode (the cost of the modes reading clock_gettime() only now
+ *  and then depends on the rate of the calls, which is the highest here).
+ */
+
+// include
+#include <string>
+#include <cstdlib>
+#include <sstream>
+#include <iostream>
+#include <unistd.h>
+#include <ysb_clock.hpp>
+
+using namespace std;
+
+// main
+int main(int argc, char *argv[])
+{
+    int option = 0;
+    size_t samples = 10000000;
+    string modes = "syscall,tsc,batch,coarse";
+    while ((option = getopt(argc, argv, "s:c:")) != -1) {
+        switch (option) {
+            case 's': samples = atol(optarg);
+                break;
+            case 'c': modes = optarg;
+                break;
+            default: {
+                cout << argv[0] << " [-s calls per mode] [-c list of syscall|tsc|batch|coarse]" << endl;
+                exit(EXIT_SUCCESS);
+            }
+        }
+    }
+    if (samples == 0) {
+        cout << argv[0] << " [-s calls per mode] [-c list of syscall|tsc|batch|coarse]" << endl;
+        exit(EXIT_FAILURE);
+    }
+    double syscall_ns = clock_cost_ns(samples, true);
+    cout << "[Bench] clock_gettime " << syscall_ns << " ns/call" << endl;
+    stringstream ss(modes);
+    string name;
+    while (getline(ss, name, ',')) {
+        clock_mode_t mode;
+        if (!parse_clock_mode(name, mode)) {
+            cout << "[Bench] Clock mode " << name << " not valid" << endl;
+            exit(EXIT_FAILURE);
+        }
+        if (!clock_init(mode)) {
+            cout << "[Bench] Clock " << name << " not supported by this machine" << endl;
+            continue;
+        }
+        cout << "[Bench] Clock " << name << " " << clock_cost_ns(samples, false) << " ns/call" << endl;
+        clock_shutdown();
+    }
+    return 0;
+}
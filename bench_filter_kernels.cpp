@@ -0,0 +1,104 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Microbenchmark of the filter kernels of the Yahoo! Streaming Benchmark
+ *
+ *  Every kernel supported by the CPU filters the same event_type column, split
+ *  in batches of the given length, for the given number of rounds. The program
+ *  prints the events/sec of each kernel and checks that all the kernels select
+ *  the same events of the scalar one.
+ */
+
+// include
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include <sys/time.h>
+#include <filter_kernels.hpp>
+
+using namespace std;
+
+// get the number of microseconds from the epoch
+static inline unsigned long current_time_usecs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return (t.tv_sec)*1000000L + (t.tv_nsec / 1000);
+}
+
+// main
+int main(int argc, char *argv[])
+{
+    int option = 0;
+    size_t batch_len = 1024;
+    size_t num_batches = 1024;
+    size_t rounds = 100;
+    while ((option = getopt(argc, argv, "b:k:r:")) != -1) {
+        switch (option) {
+            case 'b': batch_len = atoi(optarg);
+                break;
+            case 'k': num_batches = atoi(optarg);
+                break;
+            case 'r': rounds = atoi(optarg);
+                break;
+            default: {
+                cout << argv[0] << " [-b batch len] [-k num batches] [-r rounds]" << endl;
+                exit(EXIT_SUCCESS);
+            }
+        }
+    }
+    // event types generated as in the sources of the benchmark
+    size_t n = batch_len * num_batches;
+    vector<uint32_t> types(n);
+    for (size_t i=0; i<n; i++)
+        types[i] = (i % 100000) % 3;
+    vector<uint32_t> expected(n + 16);
+    vector<uint32_t> sel(n + 16);
+    size_t expected_count = 0;
+    for (size_t b=0; b<num_batches; b++)
+        expected_count += filter_scalar(&types[b * batch_len], batch_len, 0, &expected[b * batch_len]);
+    filter_isa_t isas[] = { FILTER_SCALAR, FILTER_AVX2, FILTER_AVX512 };
+    for (filter_isa_t isa: isas) {
+        if (!filter_isa_supported(isa)) {
+            cout << "[Bench] Kernel " << filter_isa_name(isa) << " not supported by this CPU" << endl;
+            continue;
+        }
+        filter_kernel_t kernel = get_filter_kernel(isa);
+        size_t selected = 0;
+        unsigned long start_us = current_time_usecs();
+        for (size_t r=0; r<rounds; r++) {
+            selected = 0;
+            for (size_t b=0; b<num_batches; b++)
+                selected += kernel(&types[b * batch_len], batch_len, 0, &sel[b * batch_len]);
+        }
+        double elapsed_sec = (current_time_usecs() - start_us) / 1000000.0;
+        // check the selection vectors batch by batch
+        bool correct = (selected == expected_count);
+        for (size_t b=0; b<num_batches && correct; b++) {
+            size_t count = filter_scalar(&types[b * batch_len], batch_len, 0, &expected[b * batch_len]);
+            correct = (kernel(&types[b * batch_len], batch_len, 0, &sel[b * batch_len]) == count) &&
+                      (memcmp(&sel[b * batch_len], &expected[b * batch_len], count * sizeof(uint32_t)) == 0);
+        }
+        cout << "[Bench] Kernel " << filter_isa_name(isa) << " " << (n * rounds) / elapsed_sec << " events/sec"
+             << " (selected " << selected << ", " << (correct ? "correct" : "WRONG") << ")" << endl;
+        if (!correct)
+            return EXIT_FAILURE;
+    }
+    return 0;
+}
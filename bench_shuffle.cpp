@@ -0,0 +1,150 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Microbenchmark of the shuffle between joins and window workers
+ *
+ *  n producer threads send keyed items to m serial consumers, either with a
+ *  try_put() on m serial TBB function nodes (as the window nodes of the
+ *  benchmark) or through the N x M mesh of SPSC rings. For each pair of
+ *  parallelism degrees the program prints the items/sec of the two shuffles.
+ */
+
+// include
+#include <vector>
+#include <thread>
+#include <string>
+#include <sstream>
+#include <cstdlib>
+#include <iostream>
+#include "tbb/tbb.h"
+#include "tbb/flow_graph.h"
+#include <ysb_clock.hpp>
+#include <spsc_shuffle.hpp>
+
+using namespace std;
+using namespace tbb::flow;
+
+// parse a comma-separated list of numbers
+static vector<size_t> parse_list(const string &list)
+{
+    vector<size_t> values;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ','))
+        values.push_back(atoi(item.c_str()));
+    return values;
+}
+
+// run the producers, each one sending num_items items with the given function
+template<typename F>
+static void run_producers(size_t n, size_t num_items, F send)
+{
+    vector<thread> producers;
+    for (size_t p=0; p<n; p++) {
+        producers.push_back(thread([p, num_items, &send] () {
+            for (uint64_t i=0; i<num_items; i++)
+                send(p, (i * 2654435761u) ^ p); // key of the item
+        }));
+    }
+    for (auto &t: producers)
+        t.join();
+}
+
+// shuffle through serial TBB function nodes (returns the consumed items)
+static uint64_t shuffle_tbb(size_t n, size_t m, size_t num_items)
+{
+    graph g;
+    vector<uint64_t> consumed(m * 8, 0); // one counter per cache line
+    vector<function_node<uint64_t, continue_msg> *> consumers;
+    for (size_t c=0; c<m; c++) {
+        uint64_t *counter = &consumed[c * 8];
+        consumers.push_back(new function_node<uint64_t, continue_msg>(g, 1, [counter] (uint64_t) { (*counter)++; return continue_msg(); }));
+    }
+    run_producers(n, num_items, [&] (size_t, uint64_t key) {
+        if (!consumers[key % m]->try_put(key)) abort();
+    });
+    g.wait_for_all();
+    uint64_t total = 0;
+    for (size_t c=0; c<m; c++) {
+        total += consumed[c * 8];
+        delete consumers[c];
+    }
+    return total;
+}
+
+// shuffle through the mesh of SPSC rings (returns the consumed items)
+static uint64_t shuffle_spsc(size_t n, size_t m, size_t num_items)
+{
+    ShuffleMesh<uint64_t> mesh(n, m);
+    vector<uint64_t> consumed(m * 8, 0); // one counter per cache line
+    for (size_t c=0; c<m; c++) {
+        uint64_t *counter = &consumed[c * 8];
+        mesh.setConsumer(c, [counter] (uint64_t) { (*counter)++; });
+    }
+    run_producers(n, num_items, [&] (size_t p, uint64_t key) {
+        mesh.push(p, key % m, key);
+    });
+    mesh.drain_all();
+    uint64_t total = 0;
+    for (size_t c=0; c<m; c++)
+        total += consumed[c * 8];
+    return total;
+}
+
+// main
+int main(int argc, char *argv[])
+{
+    int option = 0;
+    size_t num_items = 1000000;
+    string producers = "1,2,4";
+    string consumers = "1,2,4";
+    int TBBThreads = -1;
+    while ((option = getopt(argc, argv, "k:n:m:t:")) != -1) {
+        switch (option) {
+            case 'k': num_items = atoi(optarg);
+                break;
+            case 'n': producers = optarg;
+                break;
+            case 'm': consumers = optarg;
+                break;
+            case 't': TBBThreads = atoi(optarg);
+                break;
+            default: {
+                cout << argv[0] << " [-k items per producer] [-n list of par_degree] [-m list of par_degree] [-t numTBBThreads]" << endl;
+                exit(EXIT_SUCCESS);
+            }
+        }
+    }
+    tbb::task_scheduler_init init((TBBThreads > 0) ? TBBThreads : tbb::task_scheduler_init::default_num_threads());
+    for (size_t n: parse_list(producers)) {
+        for (size_t m: parse_list(consumers)) {
+            unsigned long start_us = current_time_usecs();
+            uint64_t tbb_items = shuffle_tbb(n, m, num_items);
+            double tbb_sec = (current_time_usecs() - start_us) / 1000000.0;
+            start_us = current_time_usecs();
+            uint64_t spsc_items = shuffle_spsc(n, m, num_items);
+            double spsc_sec = (current_time_usecs() - start_us) / 1000000.0;
+            if (tbb_items != n * num_items || spsc_items != n * num_items) {
+                cout << "[Bench] n=" << n << " m=" << m << " lost items" << endl;
+                return EXIT_FAILURE;
+            }
+            cout << "[Bench] n=" << n << " m=" << m << " tbb " << tbb_items / tbb_sec << " items/sec spsc "
+                 << spsc_items / spsc_sec << " items/sec" << endl;
+        }
+    }
+    return 0;
+}
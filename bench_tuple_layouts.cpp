@@ -0,0 +1,125 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Microbenchmark of the padded and compact tuple layouts
+ *
+ *  The same stream of events is processed with both layouts in three passes
+ *  over arrays of tuples, like the operators of the benchmark: the source fills
+ *  the events, the filter and the join produce the joined events of the views,
+ *  and the windows count the joined events of each campaign. The arrays are
+ *  much larger than the caches, so each pass streams its tuples from memory.
+ *  The program prints the tuples/sec and the memory traffic of each layout and
+ *  checks that both compute the same counts.
+ */
+
+// include
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+#include <sys/time.h>
+#include <ysb_common.hpp>
+
+using namespace std;
+
+// get the number of microseconds from the epoch
+static inline unsigned long current_time_usecs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return (t.tv_sec)*1000000L + (t.tv_nsec / 1000);
+}
+
+// run the three passes with a layout and return the checksum of the counts
+template<typename Event, typename Joined>
+static unsigned long run(const char *name, const vector<uint32_t> &ads, size_t ads_per_campaign, size_t num_campaigns)
+{
+    size_t n = ads.size();
+    vector<Event> events(n);
+    vector<Joined> joined(n);
+    vector<unsigned long> counts(num_campaigns, 0);
+    unsigned long start_us = current_time_usecs();
+    // source: fill the events
+    for (size_t i=0; i<n; i++) {
+        Event &e = events[i];
+        e.ts = i;
+        e.ad_id = ads[i];
+        e.ad_type = i % 5;
+        e.event_type = i % 3;
+    }
+    // filter and join: keep the views and resolve their campaigns
+    size_t m = 0;
+    for (size_t i=0; i<n; i++) {
+        const Event &e = events[i];
+        if (e.event_type != 0)
+            continue;
+        Joined &j = joined[m++];
+        j.ts = e.ts;
+        j.ad_id = e.ad_id;
+        j.cmp_id = e.ad_id / ads_per_campaign;
+        j.count = 1;
+    }
+    // windows: count the joined events of each campaign
+    for (size_t i=0; i<m; i++)
+        counts[joined[i].cmp_id] += joined[i].count;
+    double elapsed_sec = (current_time_usecs() - start_us) / 1000000.0;
+    // bytes written and read by the passes
+    double bytes = 2.0 * n * sizeof(Event) + 2.0 * m * sizeof(Joined);
+    unsigned long checksum = 0;
+    for (size_t c=0; c<num_campaigns; c++)
+        checksum += (c + 1) * counts[c];
+    cout << "[Bench] Layout " << name << " (event " << sizeof(Event) << " B, joined " << sizeof(Joined) << " B) "
+         << n / elapsed_sec << " tuples/sec " << bytes / elapsed_sec / 1e9 << " GB/s" << endl;
+    return checksum;
+}
+
+// main
+int main(int argc, char *argv[])
+{
+    int option = 0;
+    size_t num_events = 20000000;
+    size_t num_campaigns = 100;
+    size_t ads_per_campaign = 10;
+    while ((option = getopt(argc, argv, "e:c:a:")) != -1) {
+        switch (option) {
+            case 'e': num_events = atol(optarg);
+                break;
+            case 'c': num_campaigns = atol(optarg);
+                break;
+            case 'a': ads_per_campaign = atol(optarg);
+                break;
+            default: {
+                cout << argv[0] << " [-e num events] [-c num campaigns] [-a ads per campaign]" << endl;
+                exit(EXIT_SUCCESS);
+            }
+        }
+    }
+    // ads of the events (the ad ids are dense as in the relational table)
+    mt19937 gen(1);
+    uniform_int_distribution<uint32_t> dist(0, num_campaigns * ads_per_campaign - 1);
+    vector<uint32_t> ads(num_events);
+    for (size_t i=0; i<num_events; i++)
+        ads[i] = dist(gen);
+    unsigned long expected = run<padded_event_t, padded_joined_event_t>("padded", ads, ads_per_campaign, num_campaigns);
+    unsigned long checksum = run<compact_event_t, compact_joined_event_t>("compact", ads, ads_per_campaign, num_campaigns);
+    if (checksum != expected) {
+        cout << "[Bench] Compact layout computed different counts (WRONG)" << endl;
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
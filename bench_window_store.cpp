@@ -0,0 +1,145 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Microbenchmark of the keyed state stores of the window operators
+ *
+ *  For each number of keys, the same sequence of random keys updates the
+ *  count of their windows in the unordered_map of Window pointers used before
+ *  by WinAggregate and in the flat state store, without and with prefetching
+ *  the windows of the next keys. The program prints the updates/sec of each
+ *  store and checks that all of them compute the same counts.
+ */
+
+// include
+#include <string>
+#include <vector>
+#include <random>
+#include <sstream>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+#include <sys/time.h>
+#include <unordered_map>
+#include <ysb_common.hpp>
+#include <window_store.hpp>
+
+using namespace std;
+
+// get the number of microseconds from the epoch
+static inline unsigned long current_time_usecs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return (t.tv_sec)*1000000L + (t.tv_nsec / 1000);
+}
+
+// parse a comma-separated list of numbers
+static vector<size_t> parse_list(const string &list)
+{
+    vector<size_t> values;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ','))
+        values.push_back(atol(item.c_str()));
+    return values;
+}
+
+// update the window of a key
+static inline void update(Window &win, uint64_t ts)
+{
+    win.count++;
+    win.last_ts = ts;
+}
+
+// print the result of a store
+static void print_result(const char *name, size_t num_keys, size_t n, double elapsed_sec, unsigned long checksum, unsigned long expected)
+{
+    cout << "[Bench] Keys " << num_keys << " " << name << " " << n / elapsed_sec << " updates/sec"
+         << (checksum == expected ? "" : " (WRONG)") << endl;
+}
+
+// main
+int main(int argc, char *argv[])
+{
+    int option = 0;
+    size_t num_updates = 10000000;
+    string keys = "100,10000,1000000";
+    size_t prefetch_dist = 8;
+    while ((option = getopt(argc, argv, "u:k:d:")) != -1) {
+        switch (option) {
+            case 'u': num_updates = atol(optarg);
+                break;
+            case 'k': keys = optarg;
+                break;
+            case 'd': prefetch_dist = atoi(optarg);
+                break;
+            default: {
+                cout << argv[0] << " [-u num updates] [-k list of num keys] [-d prefetch distance]" << endl;
+                exit(EXIT_SUCCESS);
+            }
+        }
+    }
+    mt19937_64 gen(1);
+    for (size_t num_keys: parse_list(keys)) {
+        // random keys (campaign ids are not contiguous in the stores of the workers)
+        vector<unsigned long> seq(num_updates);
+        uniform_int_distribution<unsigned long> dist(0, num_keys - 1);
+        for (size_t i=0; i<num_updates; i++)
+            seq[i] = dist(gen) * 7919;
+        unsigned long expected = 0;
+        // unordered_map of Window pointers
+        {
+            unordered_map<unsigned long, Window *> store;
+            unsigned long start_us = current_time_usecs();
+            for (size_t i=0; i<num_updates; i++) {
+                auto it = store.find(seq[i]);
+                if (it != store.end())
+                    update(*(it->second), i);
+                else
+                    store[seq[i]] = new Window(1, i, i);
+            }
+            double elapsed_sec = (current_time_usecs() - start_us) / 1000000.0;
+            for (auto &it: store) {
+                expected += it.first * it.second->count;
+                delete it.second;
+            }
+            print_result("unordered_map", num_keys, num_updates, elapsed_sec, expected, expected);
+        }
+        // flat state store, without and with prefetching
+        for (size_t d: {(size_t) 0, prefetch_dist}) {
+            FlatStateStore<Window> store;
+            unsigned long start_us = current_time_usecs();
+            for (size_t i=0; i<num_updates; i++) {
+                if (d > 0 && i + d < num_updates)
+                    store.prefetch(seq[i + d]);
+                bool inserted;
+                Window &win = store.get(seq[i], inserted);
+                if (inserted)
+                    win.set(1, i, i);
+                else
+                    update(win, i);
+            }
+            double elapsed_sec = (current_time_usecs() - start_us) / 1000000.0;
+            unsigned long checksum = 0;
+            store.for_each([&checksum] (unsigned long key, Window &win) { checksum += key * win.count; });
+            print_result((d > 0) ? "flat+prefetch" : "flat", num_keys, num_updates, elapsed_sec, checksum, expected);
+            if (checksum != expected)
+                return EXIT_FAILURE;
+        }
+    }
+    return 0;
+}
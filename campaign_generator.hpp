@@ -26,6 +26,10 @@
 #define COMPAIGN_H
 
 // include
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
 #include <utility>
 #include <iostream>
 #include <unordered_map>
@@ -45,28 +49,204 @@ struct campaign_record
     ~campaign_record() {}
 };
 
+// kinds of join index (ad_id -> cmp_id)
+enum join_index_t { JOIN_AUTO, JOIN_HASH, JOIN_DIRECT, JOIN_FLAT };
+
+/*
+ *  Static index used by the joins to resolve the campaign of an ad. It can be
+ *  a direct-mapped array (ad_ids are compact), a flat open-addressing table
+ *  (one cache line probed in most cases) or the original unordered_map plus
+ *  relational table, kept for comparison.
+ */
+class JoinIndex {
+private:
+	// slot of the flat table
+	struct flat_slot
+	{
+		unsigned long ad_id;
+		unsigned long cmp_id;
+	};
+
+	static const unsigned long EMPTY = (unsigned long) -1; // empty slot of the flat table
+	static const uint32_t MISS = (uint32_t) -1; // empty entry of the direct array
+	static const size_t PREFETCH_DIST = 8; // distance of the prefetches in batched lookups
+
+	join_index_t kind;
+	vector<uint32_t> direct; // direct array (cmp_id of each ad_id)
+	vector<flat_slot> flat; // flat table
+	unsigned long flat_mask;
+	unsigned int flat_shift;
+	size_t flat_max_probes;
+	const unordered_map<unsigned long, unsigned int> *map; // hashmap
+	const campaign_record *relational_table; // relational table
+
+	// position of an ad_id in the flat table (Fibonacci hashing)
+	inline unsigned long flat_home(unsigned long ad_id) const
+	{
+		return (ad_id * 11400714819323198485ull) >> flat_shift;
+	}
+
+	// address touched first by the lookup of an ad_id
+	inline const void *probe_address(unsigned long ad_id) const
+	{
+		switch (kind) {
+			case JOIN_DIRECT: return (ad_id < direct.size()) ? &direct[ad_id] : nullptr;
+			case JOIN_FLAT: return &flat[flat_home(ad_id)];
+			default: return nullptr;
+		}
+	}
+
+public:
+	// constructor
+	JoinIndex(): kind(JOIN_HASH), flat_mask(0), flat_shift(0), flat_max_probes(0), map(nullptr), relational_table(nullptr) {}
+
+	// build the index of a relational table of n records
+	void build(join_index_t _kind, const campaign_record *_relational_table, size_t n, const unordered_map<unsigned long, unsigned int> *_map)
+	{
+		relational_table = _relational_table;
+		map = _map;
+		unsigned long max_ad_id = 0;
+		for (size_t k=0; k<n; k++)
+			max_ad_id = (relational_table[k].ad_id > max_ad_id) ? relational_table[k].ad_id : max_ad_id;
+		kind = _kind;
+		if (kind == JOIN_AUTO) // direct array if it is at most 4 times larger than the table
+			kind = (max_ad_id < 4 * n && max_ad_id < MISS) ? JOIN_DIRECT : JOIN_FLAT;
+		if (kind == JOIN_DIRECT) {
+			direct.assign(max_ad_id + 1, (uint32_t) MISS);
+			for (size_t k=0; k<n; k++)
+				direct[relational_table[k].ad_id] = relational_table[k].cmp_id;
+		}
+		else if (kind == JOIN_FLAT) {
+			// power-of-two capacity with load factor at most 0.5
+			unsigned int bits = 1;
+			while ((1ul << bits) < 2 * n)
+				bits++;
+			flat_shift = 64 - bits;
+			flat_mask = (1ul << bits) - 1;
+			flat.assign(1ul << bits, flat_slot{EMPTY, 0});
+			for (size_t k=0; k<n; k++) {
+				unsigned long pos = flat_home(relational_table[k].ad_id);
+				size_t probes = 1;
+				while (flat[pos].ad_id != EMPTY && flat[pos].ad_id != relational_table[k].ad_id) {
+					pos = (pos + 1) & flat_mask;
+					probes++;
+				}
+				flat[pos].ad_id = relational_table[k].ad_id;
+				flat[pos].cmp_id = relational_table[k].cmp_id;
+				flat_max_probes = (probes > flat_max_probes) ? probes : flat_max_probes;
+			}
+		}
+	}
+
+	// get the campaign of an ad (returns false if the ad is unknown)
+	inline bool find(unsigned long ad_id, unsigned long &cmp_id) const
+	{
+		if (kind == JOIN_DIRECT) {
+			if (ad_id >= direct.size() || direct[ad_id] == MISS)
+				return false;
+			cmp_id = direct[ad_id];
+			return true;
+		}
+		else if (kind == JOIN_FLAT) {
+			unsigned long pos = flat_home(ad_id);
+			while (flat[pos].ad_id != EMPTY) {
+				if (flat[pos].ad_id == ad_id) {
+					cmp_id = flat[pos].cmp_id;
+					return true;
+				}
+				pos = (pos + 1) & flat_mask;
+			}
+			return false;
+		}
+		else {
+			auto it = map->find(ad_id);
+			if (it == map->end())
+				return false;
+			cmp_id = relational_table[(*it).second].cmp_id;
+			return true;
+		}
+	}
+
+	// resolve the ads at the positions sel[0..n-1] prefetching the next
+	// lookups, and call f(position, cmp_id) for each ad found
+	template<typename Id, typename F>
+	inline void find_batch(const Id *ad_ids, const uint32_t *sel, size_t n, F f) const
+	{
+		for (size_t k=0; k<n && k<PREFETCH_DIST; k++)
+			__builtin_prefetch(probe_address(ad_ids[sel[k]]));
+		for (size_t k=0; k<n; k++) {
+			if (k + PREFETCH_DIST < n)
+				__builtin_prefetch(probe_address(ad_ids[sel[k + PREFETCH_DIST]]));
+			unsigned long cmp_id;
+			if (find(ad_ids[sel[k]], cmp_id))
+				f(sel[k], cmp_id);
+		}
+	}
+
+	// get the kind of the index
+	join_index_t getKind() const
+	{
+		return kind;
+	}
+
+	// get the maximum number of slots probed by a lookup in the flat table
+	size_t getMaxProbes() const
+	{
+		return flat_max_probes;
+	}
+};
+
+// get the name of a kind of join index
+static inline const char *join_index_name(join_index_t kind)
+{
+	switch (kind) {
+		case JOIN_AUTO: return "auto";
+		case JOIN_HASH: return "hash";
+		case JOIN_DIRECT: return "direct";
+		case JOIN_FLAT: return "flat";
+	}
+	return "unknown";
+}
+
+// parse the name of a kind of join index (returns false if unknown)
+static inline bool parse_join_index(const string &name, join_index_t &kind)
+{
+	if (name == "auto") kind = JOIN_AUTO;
+	else if (name == "hash") kind = JOIN_HASH;
+	else if (name == "direct") kind = JOIN_DIRECT;
+	else if (name == "flat") kind = JOIN_FLAT;
+	else return false;
+	return true;
+}
+
 class CampaignGenerator {
 private:
+	size_t numCampaigns;
 	unsigned int adsPerCampaign;
+	unsigned long *ads; // storage of the arrays
 	unsigned long **arrays;
 	unordered_map<unsigned long, unsigned int> map;
 	campaign_record *relational_table;
+	JoinIndex index;
 
 public:
 	// constructor
-	CampaignGenerator(unsigned int _adsPerCampaign=10): adsPerCampaign(_adsPerCampaign)
+	CampaignGenerator(size_t _numCampaigns=100, unsigned int _adsPerCampaign=10, join_index_t _index_kind=JOIN_AUTO):
+					  numCampaigns(_numCampaigns), adsPerCampaign(_adsPerCampaign)
 	{
-		// create the arrays
-		arrays = (unsigned long **) malloc(sizeof(unsigned long *) * N_CAMPAIGNS * adsPerCampaign);
-		for(size_t i=0; i<N_CAMPAIGNS*adsPerCampaign; i++)
-			arrays[i] = (unsigned long *) malloc(sizeof(unsigned long) * 2);
+		size_t num_ads = numCampaigns * adsPerCampaign;
+		// create the arrays (in a single allocation, they can be millions)
+		ads = (unsigned long *) malloc(sizeof(unsigned long) * 2 * num_ads);
+		arrays = (unsigned long **) malloc(sizeof(unsigned long *) * num_ads);
+		for(size_t i=0; i<num_ads; i++)
+			arrays[i] = &ads[2 * i];
 		// create the relational table
-		relational_table = (campaign_record *) malloc(sizeof(campaign_record) * N_CAMPAIGNS * adsPerCampaign);
+		relational_table = (campaign_record *) malloc(sizeof(campaign_record) * num_ads);
 		// initialize the arrays and the relational table
-		int value = 0;
-		int value2 = 0;
+		size_t value = 0;
+		size_t value2 = 0;
 		unsigned long ad_id, cmp_id;
-		for (size_t k=0; k<N_CAMPAIGNS; k++) {
+		for (size_t k=0; k<numCampaigns; k++) {
 			cmp_id = (value2);
 			value2++;
 			for (size_t i=0; i<adsPerCampaign; i++) {
@@ -78,22 +258,32 @@ public:
 				value++;
 			}
 		}
-		// initialize the hashmap
-		for (unsigned int k=0; k<(N_CAMPAIGNS * adsPerCampaign); k++) {
-			ad_id = relational_table[k].ad_id;
-			map.insert(pair<unsigned long, unsigned int>(ad_id, k));
+		// initialize the hashmap (only used by the hash index)
+		if (_index_kind == JOIN_HASH) {
+			map.reserve(num_ads);
+			for (unsigned int k=0; k<num_ads; k++) {
+				ad_id = relational_table[k].ad_id;
+				map.insert(pair<unsigned long, unsigned int>(ad_id, k));
+			}
 		}
+		// build the join index
+		index.build(_index_kind, relational_table, num_ads, &map);
 	}
 
 	// destructor
 	~CampaignGenerator()
 	{
 		// delete the arrays
-		for(size_t i=0; i<N_CAMPAIGNS*adsPerCampaign; i++)
-			delete arrays[i];
-		delete arrays;
+		free(arrays);
+		free(ads);
 		// delete the relational table
-		delete relational_table;
+		free(relational_table);
+	}
+
+	// get number of campaigns
+	size_t getNumCampaigns() const
+	{
+		return numCampaigns;
 	}
 
 	// get number of ads per campaign
@@ -102,6 +292,12 @@ public:
 		return adsPerCampaign;
 	}
 
+	// get number of ads of all the campaigns
+	size_t getNumAds() const
+	{
+		return numCampaigns * adsPerCampaign;
+	}
+
 	// get a pointer to the relational table
 	campaign_record *getRelationalTable() const
 	{
@@ -114,11 +310,17 @@ public:
 		return arrays;
 	}
 
-	// get a reference to the hashmap
+	// get a reference to the hashmap (empty if the join index is not hash)
 	unordered_map<unsigned long, unsigned int> &getHashMap()
 	{
 		return map;
 	}
+
+	// get a reference to the join index
+	const JoinIndex &getJoinIndex() const
+	{
+		return index;
+	}
 };
 
 #endif
@@ -0,0 +1,296 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Checkpoints of the Yahoo! Streaming Benchmark (batched version)
+ *
+ *  Checkpoints are aligned with barriers (Chandy-Lamport): every interval of
+ *  event time each source marks a batch with the id of the checkpoint (epoch)
+ *  and saves its offsets, the joins flush their combiners and forward the
+ *  barrier to all the window workers, and each worker snapshots its windows
+ *  once it has received the barrier from all the joins (the batches received
+ *  after a barrier are held until then). The snapshot is a copy of the state
+ *  in a buffer taken by the worker, while the files are written and synced by
+ *  a background thread. A checkpoint is complete when all its parts are on
+ *  disk: then the LATEST file is atomically replaced (and the directory synced)
+ *  and the older checkpoints are removed. A restarted run restores the parts
+ *  of the latest complete checkpoint and resumes the sources from their
+ *  offsets (refusing a checkpoint of sources generating other events, i.e.
+ *  with another distribution, number of campaigns or ads per campaign). Each
+ *  worker checks that the barriers it aligns belong to the same checkpoint.
+ *  The windows restored are exactly those of the checkpoint, but the
+ *  events after it are not a replay of the interrupted run: their timestamps
+ *  follow the wall clock of the new run (shifted to continue from the
+ *  checkpoint), so the windows fired after the resume can differ from those of
+ *  an uninterrupted run.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+// include
+#include <map>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+#include <type_traits>
+#include <sys/stat.h>
+#include <condition_variable>
+#include <ysb_clock.hpp>
+
+using namespace std;
+
+// Buffer with the serialized state of an operator
+class CheckpointBuffer
+{
+private:
+    vector<char> data;
+    size_t pos; // read position
+
+public:
+    // constructor
+    CheckpointBuffer(): pos(0) {}
+
+    // constructor (from the content of a part)
+    CheckpointBuffer(vector<char> &&_data): data(std::move(_data)), pos(0) {}
+
+    // append a value (trivially copyable)
+    template<typename T>
+    void put(const T &v)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable values can be saved");
+        const char *p = (const char *) &v;
+        data.insert(data.end(), p, p + sizeof(T));
+    }
+
+    // read the next value (returns false if the buffer is over)
+    template<typename T>
+    bool get(T &v)
+    {
+        if (pos + sizeof(T) > data.size())
+            return false;
+        memcpy((void *) &v, &data[pos], sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    // get the content of the buffer
+    vector<char> &content() { return data; }
+};
+
+// Store of the checkpoints in a directory, written by a background thread
+class CheckpointStore
+{
+private:
+    // part of a checkpoint waiting to be written
+    struct part_t
+    {
+        uint64_t epoch;
+        string name;
+        vector<char> data;
+    };
+
+    string dir; // directory of the checkpoints
+    uint64_t interval_us; // event time between two checkpoints
+    size_t num_parts; // parts of a complete checkpoint
+    std::mutex mutex;
+    std::condition_variable cond;
+    deque<part_t> queue; // parts waiting to be written
+    bool stopping;
+    std::thread writer;
+    map<uint64_t, vector<string>> written; // parts on disk of each checkpoint (used by the writer)
+    uint64_t last_complete; // id of the last complete checkpoint (0 if none)
+    size_t completed; // complete checkpoints
+    std::atomic<uint64_t> bytes; // bytes written
+    std::atomic<uint64_t> snapshot_us; // time spent by the operators to copy their state
+    uint64_t write_us; // time spent by the writer
+
+    // get the path of a part
+    string path(uint64_t epoch, const string &name) const
+    {
+        return dir + "/ckpt-" + to_string(epoch) + "-" + name;
+    }
+
+    // write a file and sync it to disk (returns false on errors)
+    static bool write_file(const string &file, const char *buf, size_t len)
+    {
+        int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        size_t done = 0;
+        while (done < len) {
+            ssize_t w = ::write(fd, buf + done, len - done);
+            if (w <= 0) {
+                close(fd);
+                return false;
+            }
+            done += w;
+        }
+        bool ok = (fsync(fd) == 0);
+        return (close(fd) == 0) && ok;
+    }
+
+    // sync the directory, so the names of its files (the parts and LATEST) are on disk
+    bool sync_dir()
+    {
+        int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0)
+            return false;
+        bool ok = (fsync(fd) == 0);
+        return (close(fd) == 0) && ok;
+    }
+
+    // write a part, and complete its checkpoint if it was the last one
+    void write_part(part_t &part)
+    {
+        unsigned long start_us = current_time_usecs();
+        if (!write_file(path(part.epoch, part.name), part.data.data(), part.data.size())) {
+            cerr << "[Checkpoint] Cannot write " << path(part.epoch, part.name) << endl;
+            abort();
+        }
+        bytes += part.data.size();
+        vector<string> &names = written[part.epoch];
+        names.push_back(part.name);
+        if (names.size() == num_parts) {
+            // publish the checkpoint (rename is atomic, and durable once the directory
+            // is synced) and remove the older ones
+            string latest = to_string(part.epoch);
+            if (!write_file(dir + "/LATEST.tmp", latest.c_str(), latest.size()) ||
+                rename((dir + "/LATEST.tmp").c_str(), (dir + "/LATEST").c_str()) != 0 || !sync_dir()) {
+                cerr << "[Checkpoint] Cannot publish checkpoint " << part.epoch << endl;
+                abort();
+            }
+            last_complete = part.epoch;
+            completed++;
+            while (written.begin()->first != part.epoch) {
+                for (auto &name: written.begin()->second)
+                    unlink(path(written.begin()->first, name).c_str());
+                written.erase(written.begin());
+            }
+        }
+        write_us += current_time_usecs() - start_us;
+    }
+
+public:
+    // constructor (the directory is created if it does not exist)
+    CheckpointStore(const string &_dir, uint64_t _interval_us, size_t _num_parts):
+                    dir(_dir), interval_us(_interval_us), num_parts(_num_parts), stopping(false),
+                    last_complete(0), completed(0), bytes(0), snapshot_us(0), write_us(0)
+    {
+        mkdir(dir.c_str(), 0755);
+        writer = std::thread([this] () {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                cond.wait(lock, [this] () { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                part_t part = std::move(queue.front());
+                queue.pop_front();
+                lock.unlock();
+                write_part(part); // only the writer touches the files
+                lock.lock();
+            }
+        });
+    }
+
+    // destructor
+    ~CheckpointStore()
+    {
+        stop();
+    }
+
+    // get the event time between two checkpoints (usec)
+    uint64_t interval() const
+    {
+        return interval_us;
+    }
+
+    // save a part of a checkpoint, whose state was copied in copy_us usec (thread safe)
+    void save(uint64_t epoch, const string &name, CheckpointBuffer &buf, uint64_t copy_us)
+    {
+        snapshot_us += copy_us;
+        std::lock_guard<std::mutex> lock(mutex);
+        part_t part;
+        part.epoch = epoch;
+        part.name = name;
+        part.data = std::move(buf.content());
+        queue.push_back(std::move(part));
+        cond.notify_one();
+    }
+
+    // write the pending parts and stop the writer
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping)
+                return;
+            stopping = true;
+        }
+        cond.notify_one();
+        writer.join();
+    }
+
+    // print the statistics of the checkpoints (after stop)
+    void report() const
+    {
+        cout << "[Main] Checkpoints " << completed << " completed every " << interval_us / 1000 << " ms (last " << last_complete
+             << ", " << bytes << " bytes written, snapshot copies " << snapshot_us / 1000.0 << " ms, writer " << write_us / 1000.0 << " ms)" << endl;
+    }
+
+    // get the id of the latest complete checkpoint in the directory (false if none)
+    bool latest(uint64_t &epoch) const
+    {
+        FILE *f = fopen((dir + "/LATEST").c_str(), "r");
+        if (f == nullptr)
+            return false;
+        unsigned long long e = 0;
+        bool ok = (fscanf(f, "%llu", &e) == 1);
+        fclose(f);
+        epoch = e;
+        return ok && e > 0;
+    }
+
+    // read a part of a checkpoint (false if it does not exist). The part is removed
+    // when a later checkpoint is complete (parts are loaded before saving any)
+    bool load(uint64_t epoch, const string &name, CheckpointBuffer &buf)
+    {
+        FILE *f = fopen(path(epoch, name).c_str(), "rb");
+        if (f == nullptr)
+            return false;
+        written[epoch].push_back(name);
+        vector<char> data;
+        char chunk[65536];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+            data.insert(data.end(), chunk, chunk + n);
+        fclose(f);
+        buf = CheckpointBuffer(std::move(data));
+        return true;
+    }
+};
+
+#endif
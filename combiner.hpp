@@ -0,0 +1,171 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Pre-aggregation (combiner) of the joins of the Yahoo! Streaming Benchmark
+ *
+ *  The window operators need only the count and the last timestamp of each
+ *  campaign in each window, so a join can ship one partial per campaign for
+ *  all the events of the same pane instead of one joined event per event.
+ *  The partials are flushed when the pane changes, when the time slice of
+ *  the combiner ends and at the end of the stream. Since the events of a pane
+ *  all belong to the same tumbling or sliding windows, merging the partials
+ *  gives the same results as the single events. A join holding partials must
+ *  not advance its watermark beyond the first event they contain.
+ */
+
+#ifndef COMBINER_H
+#define COMBINER_H
+
+// include
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <window_store.hpp>
+
+using namespace std;
+
+// global variable: number of events pre-aggregated by all the combiners
+std::atomic<long> combinedEvents;
+
+// global variable: number of partials shipped by all the combiners
+std::atomic<long> shippedPartials;
+
+// global variable: generation of the counters of the combiners (incremented to discard them)
+std::atomic<unsigned int> combinerEpoch(0);
+
+// Partial aggregate of a campaign in a pane
+struct partial_t
+{
+    uint64_t count; // number of events
+    uint64_t last_ts; // maximum timestamp of the events
+
+    // constructor
+    partial_t(): count(0), last_ts(0) {}
+};
+
+// Combiner of the joined events of a join
+class Combiner
+{
+private:
+    uint64_t pane_len; // length of the panes (usec)
+    uint64_t slice_len; // maximum time spanned by the partials (usec)
+    uint64_t cur_pane; // pane of the current partials
+    uint64_t slice_start; // timestamp of the first event of the current partials
+    FlatStateStore<partial_t> partials; // partial of each campaign
+    size_t pending_events; // events in the partials not flushed yet
+    size_t events; // events flushed by the combiner
+    size_t shipped; // partials flushed by the combiner
+    unsigned int epoch; // generation of events and shipped
+
+public:
+    // constructor
+    Combiner(uint64_t _pane_len=10000000, uint64_t _slice_len=1000):
+             pane_len(_pane_len), slice_len(_slice_len), cur_pane(0), slice_start(0), pending_events(0), events(0), shipped(0), epoch(0) {}
+
+    // check whether the partials must be flushed before adding an event with timestamp ts
+    inline bool boundary(uint64_t ts) const
+    {
+        return partials.size() > 0 && (ts / pane_len != cur_pane || ts - slice_start >= slice_len);
+    }
+
+    // check whether the time slice of the partials ended at time ts
+    inline bool expired(uint64_t ts) const
+    {
+        return partials.size() > 0 && ts - slice_start >= slice_len;
+    }
+
+    // check whether there are partials not flushed yet
+    inline bool pending() const
+    {
+        return partials.size() > 0;
+    }
+
+    // get the number of partials not flushed yet
+    inline size_t size() const
+    {
+        return partials.size();
+    }
+
+    // get the timestamp of the first event of the partials not flushed yet
+    inline uint64_t firstTs() const
+    {
+        return slice_start;
+    }
+
+    // add an event of a campaign
+    inline void add(unsigned long cmp_id, uint64_t ts)
+    {
+        if (partials.size() == 0) {
+            cur_pane = ts / pane_len;
+            slice_start = ts;
+        }
+        bool inserted;
+        partial_t &p = partials.get(cmp_id, inserted);
+        p.count++;
+        p.last_ts = (ts > p.last_ts) ? ts : p.last_ts;
+        pending_events++;
+    }
+
+    // call f(cmp_id, partial) for all the partials and remove them
+    template<typename F>
+    void flush(F f)
+    {
+        unsigned int cur_epoch = combinerEpoch.load(std::memory_order_relaxed);
+        if (epoch != cur_epoch) {
+            // the counters have been discarded (end of the warm-up)
+            events = 0;
+            shipped = 0;
+            epoch = cur_epoch;
+        }
+        if (partials.size() == 0)
+            return;
+        partials.for_each(f);
+        events += pending_events;
+        shipped += partials.size();
+        pending_events = 0;
+        partials.clear();
+    }
+
+    // add the counters of the combiner to the global ones (at the end of the stream, after a flush)
+    void publish() const
+    {
+        combinedEvents.fetch_add(events);
+        shippedPartials.fetch_add(shipped);
+    }
+};
+
+// discard the counters of the combiners accounted so far (e.g., during the warm-up)
+static inline void discard_combiner_counts()
+{
+    combinerEpoch++;
+}
+
+/**
+ *  \brief Function to print the traffic reduction of the combiners
+ *
+ *  This function prints the joined events and the partials shipped to the
+ *  window workers by all the combiners and their ratio.
+ */
+static inline void print_combiner_report()
+{
+    long events = combinedEvents;
+    long partials = shippedPartials;
+    cout << "[Main] Combiner shipped " << partials << " partials for " << events << " joined events (reduction "
+         << ((partials > 0) ? (double) events / partials : 1.0) << "x)" << endl;
+}
+
+#endif
@@ -0,0 +1,238 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Binary event logs of the Yahoo! Streaming Benchmark
+ *
+ *  A log is a 64-byte header followed by blocks of block_len events. Each
+ *  block stores the columns of the batched version (timestamps, ad ids and
+ *  event types), each one aligned to the cache line, so a replay source can
+ *  point its batches into the memory-mapped log without copying the events.
+ *  Timestamps are usec from the start of the recording, and the ad ids refer
+ *  to the campaigns given in the header. All the blocks have the same size
+ *  (the last one is padded).
+ */
+
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+// include
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ysb_common.hpp>
+
+using namespace std;
+
+// magic string of the event logs
+const char EVENT_LOG_MAGIC[8] = { 'Y', 'S', 'B', 'L', 'O', 'G', '1', '\0' };
+
+// header of an event log
+struct event_log_header_t
+{
+    char magic[8]; // EVENT_LOG_MAGIC
+    uint64_t num_events; // events in the log
+    uint64_t block_len; // events per block
+    uint64_t num_campaigns; // campaigns of the relational table
+    uint64_t ads_per_campaign; // ads of each campaign
+    uint32_t id_bytes; // size of the ad ids
+    uint32_t unused;
+    uint64_t reserved[2];
+};
+
+static_assert(sizeof(event_log_header_t) == 64, "event_log_header_t is not 64 bytes");
+
+// get the size of a block of the log
+static inline size_t event_log_block_bytes(size_t block_len, size_t id_bytes)
+{
+    return column_bytes(block_len, sizeof(uint64_t)) + column_bytes(block_len, id_bytes) + column_bytes(block_len, sizeof(uint32_t));
+}
+
+// Writer of an event log (the ad ids have the size of the batch columns)
+class EventLogWriter
+{
+private:
+    FILE *file;
+    event_log_header_t header;
+    vector<char> block; // block being filled
+    uint64_t *ts;
+    ysb_id_t *ad_id;
+    uint32_t *event_type;
+    size_t filled; // events in the block
+
+    // write the block and empty it
+    bool flush()
+    {
+        bool ok = fwrite(block.data(), 1, block.size(), file) == block.size();
+        std::fill(block.begin(), block.end(), 0);
+        filled = 0;
+        return ok;
+    }
+
+public:
+    // constructor
+    EventLogWriter(): file(nullptr), ts(nullptr), ad_id(nullptr), event_type(nullptr), filled(0) {}
+
+    // destructor
+    ~EventLogWriter()
+    {
+        if (file != nullptr)
+            fclose(file);
+    }
+
+    // create the log (returns false on errors)
+    bool open(const string &path, size_t block_len, size_t num_campaigns, size_t ads_per_campaign)
+    {
+        file = fopen(path.c_str(), "wb");
+        if (file == nullptr || block_len == 0)
+            return false;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, EVENT_LOG_MAGIC, sizeof(EVENT_LOG_MAGIC));
+        header.block_len = block_len;
+        header.num_campaigns = num_campaigns;
+        header.ads_per_campaign = ads_per_campaign;
+        header.id_bytes = sizeof(ysb_id_t);
+        block.assign(event_log_block_bytes(block_len, sizeof(ysb_id_t)), 0);
+        ts = (uint64_t *) block.data();
+        ad_id = (ysb_id_t *) (block.data() + column_bytes(block_len, sizeof(uint64_t)));
+        event_type = (uint32_t *) (block.data() + column_bytes(block_len, sizeof(uint64_t)) + column_bytes(block_len, sizeof(ysb_id_t)));
+        return fwrite(&header, 1, sizeof(header), file) == sizeof(header);
+    }
+
+    // append an event
+    bool append(uint64_t _ts, unsigned long _ad_id, uint32_t _event_type)
+    {
+        ts[filled] = _ts;
+        ad_id[filled] = _ad_id;
+        event_type[filled] = _event_type;
+        header.num_events++;
+        return (++filled < header.block_len) || flush();
+    }
+
+    // write the last block and the final header (returns false on errors)
+    bool close()
+    {
+        bool ok = (filled == 0) || flush();
+        ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, 1, sizeof(header), file) == sizeof(header);
+        ok = (fclose(file) == 0) && ok;
+        file = nullptr;
+        return ok;
+    }
+};
+
+// Event log mapped in memory (read only)
+class EventLog
+{
+private:
+    const char *base; // start of the mapping
+    size_t length; // length of the mapping
+    event_log_header_t header;
+    size_t num_blocks;
+    size_t block_bytes;
+
+public:
+    // constructor
+    EventLog(): base(nullptr), length(0), num_blocks(0), block_bytes(0)
+    {
+        memset(&header, 0, sizeof(header));
+    }
+
+    // the mapping is not copied
+    EventLog(const EventLog &) = delete;
+    EventLog &operator=(const EventLog &) = delete;
+
+    // destructor
+    ~EventLog()
+    {
+        if (base != nullptr)
+            munmap((void *) base, length);
+    }
+
+    // map a log (returns false if it cannot be mapped or is not valid)
+    bool open(const string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(header)) {
+            close(fd);
+            return false;
+        }
+        length = st.st_size;
+        void *mem = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // the mapping keeps the file open
+        if (mem == MAP_FAILED)
+            return false;
+        base = (const char *) mem;
+        madvise(mem, length, MADV_SEQUENTIAL);
+        memcpy(&header, base, sizeof(header));
+        if (memcmp(header.magic, EVENT_LOG_MAGIC, sizeof(EVENT_LOG_MAGIC)) != 0 || header.block_len == 0 ||
+            (header.id_bytes != sizeof(uint32_t) && header.id_bytes != sizeof(uint64_t)))
+            return false;
+        block_bytes = event_log_block_bytes(header.block_len, header.id_bytes);
+        num_blocks = (header.num_events + header.block_len - 1) / header.block_len;
+        return sizeof(header) + num_blocks * block_bytes <= length;
+    }
+
+    // get the number of events
+    size_t numEvents() const { return header.num_events; }
+
+    // get the number of blocks
+    size_t numBlocks() const { return num_blocks; }
+
+    // get the number of events of a block
+    size_t blockSize(size_t b) const
+    {
+        return (b + 1 < num_blocks) ? header.block_len : header.num_events - b * header.block_len;
+    }
+
+    // get the number of campaigns of the relational table
+    size_t numCampaigns() const { return header.num_campaigns; }
+
+    // get the number of ads per campaign
+    size_t adsPerCampaign() const { return header.ads_per_campaign; }
+
+    // get the size of the ad ids
+    size_t idBytes() const { return header.id_bytes; }
+
+    // get the column of the timestamps of a block
+    const uint64_t *timestamps(size_t b) const
+    {
+        return (const uint64_t *) (base + sizeof(header) + b * block_bytes);
+    }
+
+    // get the column of the ad ids of a block (of idBytes() each)
+    const char *adIds(size_t b) const
+    {
+        return base + sizeof(header) + b * block_bytes + column_bytes(header.block_len, sizeof(uint64_t));
+    }
+
+    // get the column of the event types of a block
+    const uint32_t *eventTypes(size_t b) const
+    {
+        return (const uint32_t *) (adIds(b) + column_bytes(header.block_len, header.id_bytes));
+    }
+};
+
+#endif
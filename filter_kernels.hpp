@@ -0,0 +1,191 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Filter kernels of the Yahoo! Streaming Benchmark (batched version)
+ *
+ *  Each kernel scans the event_type column of a batch and writes the positions
+ *  of the events equal to a given type into a compacted selection vector,
+ *  without branching on the single events. The AVX2 and AVX-512 kernels are
+ *  compiled with function target attributes and are selected at run-time
+ *  according to the features of the CPU.
+ */
+
+#ifndef FILTER_KERNELS_H
+#define FILTER_KERNELS_H
+
+// include
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define YSB_X86_KERNELS
+#endif
+
+using namespace std;
+
+// type of a filter kernel: returns the number of selected events
+typedef size_t (*filter_kernel_t)(const uint32_t *types, size_t n, uint32_t value, uint32_t *sel);
+
+// instruction set levels of the filter kernels
+enum filter_isa_t { FILTER_SCALAR, FILTER_AVX2, FILTER_AVX512 };
+
+// scalar kernel (the compare result is added to the output index)
+static inline size_t filter_scalar(const uint32_t *types, size_t n, uint32_t value, uint32_t *sel)
+{
+    size_t k = 0;
+    for (size_t i=0; i<n; i++) {
+        sel[k] = i;
+        k += (types[i] == value);
+    }
+    return k;
+}
+
+#if defined(YSB_X86_KERNELS)
+// table of the permutations used by the AVX2 kernel: entry m lists the lanes
+// set in the 8-bit mask m, in increasing order
+static inline const uint32_t *filter_avx2_lut()
+{
+    static uint32_t lut[256][8];
+    static bool initialized = [] () {
+        for (int m=0; m<256; m++) {
+            int k = 0;
+            for (int l=0; l<8; l++) {
+                if (m & (1 << l))
+                    lut[m][k++] = l;
+            }
+            for (; k<8; k++)
+                lut[m][k] = 0;
+        }
+        return true;
+    }();
+    (void) initialized;
+    return &lut[0][0];
+}
+
+// AVX2 kernel: 8 lanes per step, the positions of the matching lanes are
+// compacted with a permutation taken from the table above. Since k <= i the
+// full-width store never writes past position i+7
+__attribute__((target("avx2,popcnt")))
+static size_t filter_avx2(const uint32_t *types, size_t n, uint32_t value, uint32_t *sel)
+{
+    const uint32_t *lut = filter_avx2_lut();
+    const __m256i key = _mm256_set1_epi32(value);
+    const __m256i eight = _mm256_set1_epi32(8);
+    __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    size_t k = 0;
+    size_t i = 0;
+    for (; i+8<=n; i+=8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (types + i));
+        unsigned int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, key)));
+        __m256i perm = _mm256_loadu_si256((const __m256i *) (lut + mask * 8));
+        _mm256_storeu_si256((__m256i *) (sel + k), _mm256_permutevar8x32_epi32(idx, perm));
+        k += _mm_popcnt_u32(mask);
+        idx = _mm256_add_epi32(idx, eight);
+    }
+    for (; i<n; i++) {
+        sel[k] = i;
+        k += (types[i] == value);
+    }
+    return k;
+}
+
+// AVX-512 kernel: 16 lanes per step, compacted with a compress store
+__attribute__((target("avx512f,popcnt")))
+static size_t filter_avx512(const uint32_t *types, size_t n, uint32_t value, uint32_t *sel)
+{
+    const __m512i key = _mm512_set1_epi32(value);
+    const __m512i sixteen = _mm512_set1_epi32(16);
+    __m512i idx = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    size_t k = 0;
+    size_t i = 0;
+    for (; i+16<=n; i+=16) {
+        __m512i v = _mm512_loadu_si512((const void *) (types + i));
+        __mmask16 mask = _mm512_cmpeq_epi32_mask(v, key);
+        _mm512_mask_compressstoreu_epi32((void *) (sel + k), mask, idx);
+        k += _mm_popcnt_u32(mask);
+        idx = _mm512_add_epi32(idx, sixteen);
+    }
+    for (; i<n; i++) {
+        sel[k] = i;
+        k += (types[i] == value);
+    }
+    return k;
+}
+#endif
+
+// check whether the CPU can run the kernel of a given level
+static inline bool filter_isa_supported(filter_isa_t isa)
+{
+#if defined(YSB_X86_KERNELS)
+    switch (isa) {
+        case FILTER_SCALAR: return true;
+        case FILTER_AVX2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+        case FILTER_AVX512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("popcnt");
+    }
+    return false;
+#else
+    return isa == FILTER_SCALAR;
+#endif
+}
+
+// get the highest level supported by the CPU
+static inline filter_isa_t best_filter_isa()
+{
+    if (filter_isa_supported(FILTER_AVX512))
+        return FILTER_AVX512;
+    if (filter_isa_supported(FILTER_AVX2))
+        return FILTER_AVX2;
+    return FILTER_SCALAR;
+}
+
+// get the kernel of a given level (the scalar one if not supported)
+static inline filter_kernel_t get_filter_kernel(filter_isa_t isa)
+{
+    if (!filter_isa_supported(isa))
+        return filter_scalar;
+#if defined(YSB_X86_KERNELS)
+    if (isa == FILTER_AVX512)
+        return filter_avx512;
+    if (isa == FILTER_AVX2)
+        return filter_avx2;
+#endif
+    return filter_scalar;
+}
+
+// get the name of a level
+static inline const char *filter_isa_name(filter_isa_t isa)
+{
+    switch (isa) {
+        case FILTER_SCALAR: return "scalar";
+        case FILTER_AVX2: return "avx2";
+        case FILTER_AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+// parse the name of a level (returns false if unknown)
+static inline bool parse_filter_isa(const string &name, filter_isa_t &isa)
+{
+    if (name == "scalar") isa = FILTER_SCALAR;
+    else if (name == "avx2") isa = FILTER_AVX2;
+    else if (name == "avx512") isa = FILTER_AVX512;
+    else return false;
+    return true;
+}
+
+#endif
@@ -0,0 +1,113 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Generator of the event logs replayed by the batched version (option -i)
+ *
+ *  The events are produced like in the sources of the benchmark (ads drawn from
+ *  the chosen distribution, event types cycling over view, click and purchase)
+ *  and their timestamps are spaced according to the recorded rate. The log is
+ *  written in blocks of columns (see event_log.hpp) with the id width of the
+ *  tuple layout the program was compiled with.
+ */
+
+// include
+#include <string>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+#include <sys/time.h>
+#include <ysb_common.hpp>
+#include <event_log.hpp>
+#include <ad_distribution.hpp>
+#include <campaign_generator.hpp>
+
+using namespace std;
+
+// get the number of microseconds from the epoch
+static inline unsigned long current_time_usecs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return (t.tv_sec)*1000000L + (t.tv_nsec / 1000);
+}
+
+// main
+int main(int argc, char *argv[])
+{
+    int option = 0;
+    string path;
+    size_t num_events = 10000000;
+    size_t num_campaigns = 100;
+    size_t ads_per_campaign = 10;
+    AdDistribution ad_dist;
+    double rate = 1000000;
+    size_t block_len = 4096;
+    while ((option = getopt(argc, argv, "o:e:C:A:d:r:b:")) != -1) {
+        switch (option) {
+            case 'o': path = optarg;
+                break;
+            case 'e': num_events = atol(optarg);
+                break;
+            case 'C': num_campaigns = atol(optarg);
+                break;
+            case 'A': ads_per_campaign = atol(optarg);
+                break;
+            case 'd': {
+                if (!parse_ad_distribution(optarg, ad_dist)) {
+                    cout << "[Gen] Ad distribution " << optarg << " not valid" << endl;
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            }
+            case 'r': rate = atof(optarg);
+                break;
+            case 'b': block_len = atol(optarg);
+                break;
+            default: {
+                cout << argv[0] << " -o file [-e num events] [-C num campaigns] [-A ads per campaign] [-d ad distribution] [-r recorded rate (events/sec)] [-b events per block]" << endl;
+                exit(EXIT_SUCCESS);
+            }
+        }
+    }
+    if (path.empty() || num_events == 0 || num_campaigns == 0 || ads_per_campaign == 0 || rate <= 0 || block_len == 0) {
+        cout << argv[0] << " -o file [-e num events] [-C num campaigns] [-A ads per campaign] [-d ad distribution] [-r recorded rate (events/sec)] [-b events per block]" << endl;
+        exit(EXIT_FAILURE);
+    }
+    CampaignGenerator campaign_gen(num_campaigns, ads_per_campaign);
+    unsigned long **ads_arrays = campaign_gen.getArrays();
+    AdSampler sampler(ad_dist, campaign_gen.getNumAds(), 0);
+    EventLogWriter writer;
+    if (!writer.open(path, block_len, num_campaigns, ads_per_campaign)) {
+        cout << "[Gen] Cannot create the event log " << path << endl;
+        exit(EXIT_FAILURE);
+    }
+    unsigned long start_us = current_time_usecs();
+    bool ok = true;
+    for (size_t i=0; i<num_events && ok; i++) {
+        uint64_t ts = (uint64_t) (i * 1000000.0 / rate);
+        ok = writer.append(ts, ads_arrays[sampler.next()][1], (i % 100000) % 3);
+    }
+    ok = writer.close() && ok;
+    if (!ok) {
+        cout << "[Gen] Error writing the event log " << path << endl;
+        exit(EXIT_FAILURE);
+    }
+    double elapsed_sec = (current_time_usecs() - start_us) / 1000000.0;
+    cout << "[Gen] Written " << num_events << " events (" << ad_distribution_name(ad_dist) << ", " << (uint64_t) (num_events * 1000000.0 / rate) / 1000 << " ms at the recorded rate) to " << path
+         << " in blocks of " << block_len << " events, " << sizeof(ysb_id_t) << " B ids (" << elapsed_sec << " sec)" << endl;
+    return 0;
+}
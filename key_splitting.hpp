@@ -0,0 +1,138 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Hot-key splitting of the Yahoo! Streaming Benchmark
+ *
+ *  Each join samples the campaigns it routes in a small lossy sketch and, at
+ *  the end of every period, marks as hot the campaigns whose share of the
+ *  samples exceeds half the fair share of a window worker. The tuples of a hot
+ *  campaign are spread over several workers (the least loaded, as seen by the
+ *  join, among split consecutive workers starting from the home one), and the
+ *  partial windows are merged downstream.
+ */
+
+#ifndef KEY_SPLITTING_H
+#define KEY_SPLITTING_H
+
+// include
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+// Detector of the hot keys routed by a join
+class HotKeyDetector
+{
+private:
+    static const size_t SLOTS = 1024; // slots of the sketch (power of two)
+    static const size_t SAMPLING = 8; // one tuple sampled every SAMPLING
+    static const size_t PERIOD = 8192; // samples between two updates of the hot keys
+    static const unsigned long EMPTY = (unsigned long) -1;
+
+    // slot of the sketch
+    struct slot_t
+    {
+        unsigned long key;
+        uint32_t count;
+    };
+
+    vector<slot_t> sketch;
+    vector<unsigned long> hot; // hot key of each slot (EMPTY if none)
+    size_t n_workers;
+    size_t tuples;
+    size_t samples;
+    size_t hot_keys; // number of hot keys in the last period
+
+    // slot of a key
+    static inline size_t slot_of(unsigned long key)
+    {
+        return (key * 11400714819323198485ull) >> 54; // 10 bits
+    }
+
+    // update the hot keys with the counts of the last period
+    void end_period()
+    {
+        uint32_t threshold = (uint32_t) (PERIOD / (2 * n_workers));
+        hot_keys = 0;
+        for (size_t s=0; s<SLOTS; s++) {
+            hot[s] = (sketch[s].count >= threshold) ? sketch[s].key : EMPTY;
+            hot_keys += (hot[s] != EMPTY);
+            sketch[s].count = 0;
+        }
+        samples = 0;
+    }
+
+public:
+    // constructor
+    HotKeyDetector(size_t _n_workers=1): sketch(SLOTS, slot_t{EMPTY, 0}), hot(SLOTS, (unsigned long) EMPTY),
+                                         n_workers(_n_workers), tuples(0), samples(0), hot_keys(0) {}
+
+    // count a routed key
+    inline void add(unsigned long key)
+    {
+        if ((++tuples % SAMPLING) != 0)
+            return;
+        slot_t &s = sketch[slot_of(key)];
+        if (s.key == key)
+            s.count++;
+        else if (s.count == 0) {
+            s.key = key;
+            s.count = 1;
+        }
+        else
+            s.count--; // the resident key must stay more frequent to keep the slot
+        if (++samples == PERIOD)
+            end_period();
+    }
+
+    // check whether a key is hot
+    inline bool isHot(unsigned long key) const
+    {
+        return hot[slot_of(key)] == key;
+    }
+
+    // get the number of hot keys
+    size_t hotKeys() const
+    {
+        return hot_keys;
+    }
+};
+
+/**
+ *  \brief Function to print the load of the window workers
+ *
+ *  This function prints the tuples processed by each window worker and the
+ *  imbalance, i.e. the ratio between the maximum and the average load.
+ */
+static inline void print_worker_load(const vector<size_t> &load)
+{
+    size_t total = 0;
+    size_t max_load = 0;
+    for (auto l: load) {
+        total += l;
+        max_load = std::max(max_load, l);
+    }
+    cout << "[Main] Worker load (tuples):";
+    for (size_t i=0; i<load.size(); i++)
+        cout << " " << load[i];
+    double avg = (double) total / load.size();
+    cout << " (imbalance " << ((total > 0) ? max_load / avg : 1.0) << ")" << endl;
+}
+
+#endif
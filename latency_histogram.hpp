@@ -0,0 +1,214 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Latency histograms of the Yahoo! Streaming Benchmark
+ *
+ *  Latencies are recorded by the operators in per-thread histograms with
+ *  HDR-style log-linear buckets (relative error below 1%), which are merged
+ *  by the main thread once the graph has terminated. The latencies recorded
+ *  during the warm-up are discarded by starting a new generation: each thread
+ *  resets its histograms when it records the first latency of the generation.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+// include
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+
+using namespace std;
+
+// Histogram of latencies in microseconds
+class LatencyHistogram
+{
+private:
+    static const unsigned int SUB_BITS = 8; // values below 2^SUB_BITS are exact
+    static const unsigned int MAX_BITS = 40; // larger values are clamped to 2^MAX_BITS-1
+    static const size_t HALF = 1ul << (SUB_BITS - 1);
+    static const size_t NUM_BUCKETS = (1ul << SUB_BITS) + (MAX_BITS - SUB_BITS + 1) * HALF;
+
+    vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t max_value;
+    uint64_t sum;
+
+    // bucket of a value
+    static inline size_t index(uint64_t v)
+    {
+        if (v < (1ul << SUB_BITS))
+            return v;
+        if (v >= (1ul << MAX_BITS))
+            v = (1ul << MAX_BITS) - 1;
+        unsigned int shift = (63 - __builtin_clzl(v)) - (SUB_BITS - 1); // keep SUB_BITS significant bits
+        return (1ul << SUB_BITS) + (shift - 1) * HALF + ((v >> shift) - HALF);
+    }
+
+    // highest value falling in a bucket
+    static inline uint64_t highest(size_t idx)
+    {
+        if (idx < (1ul << SUB_BITS))
+            return idx;
+        size_t shift = (idx - (1ul << SUB_BITS)) / HALF + 1;
+        uint64_t sub = (idx - (1ul << SUB_BITS)) % HALF + HALF;
+        return ((sub + 1) << shift) - 1;
+    }
+
+public:
+    // constructor
+    LatencyHistogram(): counts(NUM_BUCKETS, 0), total(0), max_value(0), sum(0) {}
+
+    // record a latency
+    inline void record(uint64_t v)
+    {
+        counts[index(v)]++;
+        total++;
+        sum += v;
+        max_value = (v > max_value) ? v : max_value;
+    }
+
+    // add all the latencies recorded by another histogram
+    void merge(const LatencyHistogram &other)
+    {
+        for (size_t i=0; i<NUM_BUCKETS; i++)
+            counts[i] += other.counts[i];
+        total += other.total;
+        sum += other.sum;
+        max_value = (other.max_value > max_value) ? other.max_value : max_value;
+    }
+
+    // forget all the recorded latencies
+    void reset()
+    {
+        counts.assign(NUM_BUCKETS, 0);
+        total = 0;
+        sum = 0;
+        max_value = 0;
+    }
+
+    // get the value below which falls the given percentage of the latencies
+    uint64_t percentile(double p) const
+    {
+        if (total == 0)
+            return 0;
+        uint64_t rank = (uint64_t) ((p / 100.0) * total + 0.5);
+        rank = (rank == 0) ? 1 : rank;
+        uint64_t seen = 0;
+        for (size_t i=0; i<NUM_BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank)
+                return (highest(i) < max_value) ? highest(i) : max_value;
+        }
+        return max_value;
+    }
+
+    // get the number of recorded latencies
+    uint64_t count() const { return total; }
+
+    // get the maximum latency
+    uint64_t max() const { return max_value; }
+
+    // get the average latency
+    double mean() const { return (total > 0) ? ((double) sum) / total : 0; }
+};
+
+// latencies measured by the benchmark
+enum latency_metric_t { LAT_TUPLE, LAT_RESULT, LAT_NUM_METRICS };
+
+// histograms of a thread and their generation
+struct latency_slot_t
+{
+    LatencyHistogram histograms[LAT_NUM_METRICS];
+    std::atomic<unsigned int> epoch;
+};
+
+// global variable: per-thread histograms
+vector<latency_slot_t *> latencyHistograms;
+
+// global variable: generation of the latencies (older histograms are discarded)
+std::atomic<unsigned int> latencyEpoch(0);
+
+// global variable: mutex protecting latencyHistograms
+std::mutex latencyHistogramsMutex;
+
+/**
+ *  \brief Function to get the histograms of the calling thread
+ *
+ *  This function returns the array of histograms of the calling thread, which
+ *  is created and registered at the first call, and emptied at the first call
+ *  of a new generation.
+ */
+static inline LatencyHistogram *my_latency_histograms()
+{
+    static thread_local latency_slot_t *slot = nullptr;
+    unsigned int epoch = latencyEpoch.load(std::memory_order_relaxed);
+    if (slot == nullptr) {
+        slot = new latency_slot_t();
+        slot->epoch = epoch;
+        std::lock_guard<std::mutex> lock(latencyHistogramsMutex);
+        latencyHistograms.push_back(slot);
+    }
+    else if (slot->epoch.load(std::memory_order_relaxed) != epoch) {
+        for (size_t m=0; m<LAT_NUM_METRICS; m++)
+            slot->histograms[m].reset();
+        slot->epoch.store(epoch, std::memory_order_relaxed);
+    }
+    return slot->histograms;
+}
+
+// discard the latencies recorded so far (start a new generation)
+static inline void discard_latencies()
+{
+    latencyEpoch++;
+}
+
+// get the latency between two times (zero if the clocks of the two threads disagree)
+static inline uint64_t latency_between(uint64_t from_us, uint64_t to_us)
+{
+    return (to_us > from_us) ? to_us - from_us : 0;
+}
+
+// record a latency (usec) of a metric in the histogram of the calling thread
+static inline void record_latency(latency_metric_t metric, uint64_t latency_us)
+{
+    my_latency_histograms()[metric].record(latency_us);
+}
+
+// merge the histograms of all the threads for a metric
+static inline LatencyHistogram merged_latency(latency_metric_t metric)
+{
+    LatencyHistogram result;
+    std::lock_guard<std::mutex> lock(latencyHistogramsMutex);
+    for (auto slot: latencyHistograms) {
+        if (slot->epoch == latencyEpoch)
+            result.merge(slot->histograms[metric]);
+    }
+    return result;
+}
+
+// print the percentiles of a histogram
+static inline void print_latency(const string &name, const LatencyHistogram &h)
+{
+    cout << "[Main] " << name << " latency (usec) p50 " << h.percentile(50) << " p99 " << h.percentile(99)
+         << " p99.9 " << h.percentile(99.9) << " max " << h.max() << " (" << h.count() << " samples)" << endl;
+}
+
+#endif
@@ -0,0 +1,276 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  NUMA-aware placement of the Yahoo! Streaming Benchmark
+ *
+ *  Each NUMA node gets a TBB arena whose threads are pinned to the CPUs of the
+ *  node by an observer. The operators placed on a node belong to flow graphs
+ *  created inside its arena, so their tasks run on the threads of the node and
+ *  the memory they allocate (events and batches, also from the pools) is
+ *  first-touched there. Read-only structures like the join index are
+ *  replicated on every node. The main thread is pinned to a node only while it
+ *  runs there (its affinity is restored at the end). The topology is read from
+ *  sysfs, so no library is needed.
+ */
+
+#ifndef NUMA_PLACEMENT_H
+#define NUMA_PLACEMENT_H
+
+// include
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <sched.h>
+#include "tbb/task_arena.h"
+#include "tbb/task_scheduler_observer.h"
+
+using namespace std;
+
+// global variable: true if the operators are placed on the NUMA nodes
+bool numaEnabled = false;
+
+// global variable: NUMA node of each window worker
+vector<int> numaWorkerNode;
+
+// global variable: NUMA node of the calling thread (-1 if not pinned)
+thread_local int numaThreadNode = -1;
+
+// tuples sent by a thread to window workers on its node and on other nodes
+struct numa_traffic_t
+{
+    uint64_t local;
+    uint64_t remote;
+};
+
+// global variable: per-thread traffic counters
+vector<numa_traffic_t *> numaTraffic;
+std::mutex numaTrafficMutex;
+
+// parse a list of CPUs in the sysfs format (e.g. "0-3,8-11")
+static inline vector<int> numa_parse_cpulist(const string &list)
+{
+    vector<int> cpus;
+    stringstream ss(list);
+    string range;
+    while (getline(ss, range, ',')) {
+        size_t dash = range.find('-');
+        int first = atoi(range.substr(0, dash).c_str());
+        int last = (dash == string::npos) ? first : atoi(range.substr(dash + 1).c_str());
+        for (int c=first; c<=last; c++)
+            cpus.push_back(c);
+    }
+    return cpus;
+}
+
+/**
+ *  \brief Function to read the NUMA topology
+ *
+ *  This function returns the CPUs of each NUMA node of the machine. If the
+ *  machine has no NUMA information, all the CPUs are in a single node.
+ */
+static inline vector<vector<int>> numa_topology()
+{
+    vector<vector<int>> nodes;
+    for (int n=0; ; n++) {
+        ifstream file("/sys/devices/system/node/node" + to_string(n) + "/cpulist");
+        string list;
+        if (!file || !getline(file, list))
+            break;
+        vector<int> cpus = numa_parse_cpulist(list);
+        if (!cpus.empty()) // skip memory-only nodes
+            nodes.push_back(cpus);
+    }
+    if (nodes.empty()) {
+        nodes.push_back(vector<int>());
+        for (unsigned int c=0; c<std::thread::hardware_concurrency(); c++)
+            nodes[0].push_back(c);
+    }
+    return nodes;
+}
+
+// pin the calling thread to a set of CPUs
+static inline void numa_pin_thread(const vector<int> &cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto c: cpus)
+        CPU_SET(c, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+// count the tuples sent by the calling thread to a window worker
+static inline void numa_record_traffic(size_t worker, uint64_t tuples)
+{
+    if (!numaEnabled)
+        return;
+    static thread_local numa_traffic_t *traffic = nullptr;
+    if (traffic == nullptr) {
+        traffic = new numa_traffic_t{0, 0};
+        std::lock_guard<std::mutex> lock(numaTrafficMutex);
+        numaTraffic.push_back(traffic);
+    }
+    if (numaThreadNode == numaWorkerNode[worker])
+        traffic->local += tuples;
+    else
+        traffic->remote += tuples;
+}
+
+// print the traffic between the joins and the window workers
+static inline void numa_report()
+{
+    if (!numaEnabled)
+        return;
+    uint64_t local = 0, remote = 0;
+    std::lock_guard<std::mutex> lock(numaTrafficMutex);
+    for (auto t: numaTraffic) {
+        local += t->local;
+        remote += t->remote;
+    }
+    double perc = (local + remote > 0) ? (100.0 * remote) / (local + remote) : 0;
+    cout << "[Main] NUMA cross-socket tuples " << remote << " of " << local + remote << " (" << perc << "%)" << endl;
+}
+
+// Placement of the operators on the NUMA nodes
+class NumaPlacement
+{
+private:
+    // observer pinning the threads entering an arena to the CPUs of its node
+    class pinning_observer: public tbb::task_scheduler_observer
+    {
+    private:
+        int node;
+        vector<int> cpus;
+
+    public:
+        // constructor
+        pinning_observer(tbb::task_arena &_arena, int _node, const vector<int> &_cpus):
+                         tbb::task_scheduler_observer(_arena), node(_node), cpus(_cpus)
+        {
+            observe(true);
+        }
+
+        // called when a thread enters the arena
+        void on_scheduler_entry(bool) override
+        {
+            if (numaThreadNode != node) {
+                numa_pin_thread(cpus);
+                numaThreadNode = node;
+            }
+        }
+    };
+
+    vector<vector<int>> nodes; // CPUs of each node
+    vector<tbb::task_arena *> arenas; // arena of each node (empty if disabled)
+    vector<pinning_observer *> observers;
+
+public:
+    // constructor (placement disabled)
+    NumaPlacement() {}
+
+    // destructor
+    ~NumaPlacement()
+    {
+        for (auto o: observers) {
+            o->observe(false);
+            delete o;
+        }
+        for (auto a: arenas)
+            delete a;
+    }
+
+    /**
+     *  \brief Method to enable the placement
+     *
+     *  This method creates an arena for each NUMA node sharing the num_threads
+     *  TBB threads in proportion to the CPUs of the nodes (a node without
+     *  workers runs only while the main thread waits on its graphs). If
+     *  num_nodes is not zero and the machine has fewer nodes, its CPUs are
+     *  split among num_nodes virtual nodes (to test the placement on smaller
+     *  machines).
+     */
+    void init(size_t num_nodes, int num_threads)
+    {
+        nodes = numa_topology();
+        if (num_nodes > nodes.size()) {
+            vector<int> cpus;
+            for (auto &n: nodes)
+                cpus.insert(cpus.end(), n.begin(), n.end());
+            nodes.assign(num_nodes, vector<int>());
+            for (size_t k=0; k<num_nodes || k<cpus.size(); k++)
+                nodes[k % num_nodes].push_back(cpus[k % cpus.size()]);
+        }
+        else if (num_nodes > 0)
+            nodes.resize(num_nodes);
+        size_t total_cpus = 0;
+        for (auto &n: nodes)
+            total_cpus += n.size();
+        for (size_t k=0; k<nodes.size(); k++) {
+            // workers of the node plus one slot for the main thread waiting on its graphs
+            int workers = (int) ((num_threads - 1) * nodes[k].size() / total_cpus);
+            arenas.push_back(new tbb::task_arena(workers + 1, 1));
+            arenas[k]->initialize();
+            observers.push_back(new pinning_observer(*arenas[k], k, nodes[k]));
+        }
+        numaEnabled = true;
+    }
+
+    // get the number of nodes (one if the placement is disabled)
+    size_t numNodes() const
+    {
+        return arenas.empty() ? 1 : arenas.size();
+    }
+
+    // run a function on a thread of a node (the affinity of the caller is restored at the end)
+    template<typename F>
+    void execute(size_t node, F f)
+    {
+        if (arenas.empty()) {
+            f();
+            return;
+        }
+        cpu_set_t saved;
+        bool restore = (sched_getaffinity(0, sizeof(saved), &saved) == 0);
+        int saved_node = numaThreadNode;
+        arenas[node]->execute(f);
+        if (restore) {
+            sched_setaffinity(0, sizeof(saved), &saved);
+            numaThreadNode = saved_node;
+        }
+    }
+
+    // create a copy of an object in the memory of a node
+    template<typename T>
+    T *replicate(const T &obj, size_t node)
+    {
+        if (arenas.empty())
+            return new T(obj);
+        T *copy = nullptr;
+        std::thread t([&] () {
+            numa_pin_thread(nodes[node]);
+            copy = new T(obj); // first touch on the node
+        });
+        t.join();
+        return copy;
+    }
+};
+
+#endif
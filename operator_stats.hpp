@@ -0,0 +1,364 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Per-operator instrumentation of the Yahoo! Streaming Benchmark
+ *
+ *  The operators count the tuples they receive and produce, and time a sample
+ *  of their invocations with the cycle counter, in per-thread counters (each
+ *  thread has its own cache lines and is the only writer of its counters). A reporter
+ *  thread merges the counters every interval and prints the rates, the cores
+ *  kept busy by each operator (the sources include the pacing of the rate
+ *  limiter) and the tuples queued between consecutive operators. A breakdown
+ *  of the whole run is printed at the end. Compiling with -DYSB_NO_STATS
+ *  removes the instrumentation from the operators.
+ */
+
+#ifndef OPERATOR_STATS_H
+#define OPERATOR_STATS_H
+
+// include
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <ysb_clock.hpp>
+
+using namespace std;
+
+// instrumented operators (the lane is the fused source, filter and join)
+enum op_kind_t { OP_SOURCE, OP_FILTER, OP_JOIN, OP_LANE, OP_WINDOW, OP_SINK, OP_NUM_KINDS };
+
+// get the name of an instrumented operator
+static inline const char *op_kind_name(op_kind_t kind)
+{
+    switch (kind) {
+        case OP_SOURCE: return "source";
+        case OP_FILTER: return "filter";
+        case OP_JOIN: return "join";
+        case OP_LANE: return "lane";
+        case OP_WINDOW: return "window";
+        default: return "sink";
+    }
+}
+
+// counters of an operator in a thread (written only by the thread)
+struct alignas(64) op_counters_t
+{
+    std::atomic<uint64_t> in; // tuples received
+    std::atomic<uint64_t> out; // tuples produced
+    std::atomic<uint64_t> calls; // invocations
+    std::atomic<uint64_t> busy; // ticks spent in the invocations
+
+    // constructor
+    op_counters_t(): in(0), out(0), calls(0), busy(0) {}
+};
+
+// totals of an operator across the threads
+struct op_totals_t
+{
+    uint64_t in;
+    uint64_t out;
+    uint64_t calls;
+    uint64_t busy;
+    size_t threads; // threads which run the operator
+
+    // constructor
+    op_totals_t(): in(0), out(0), calls(0), busy(0), threads(0) {}
+};
+
+// get the current value of the cycle counter (nsec if not available)
+static inline uint64_t stats_ticks()
+{
+#if defined(YSB_HAS_TSC)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// invocations of an operator in a thread sharing the same timing
+const uint64_t STATS_SAMPLE_CALLS = 64;
+
+// global variable: per-thread counters (one array of OP_NUM_KINDS per thread)
+vector<op_counters_t *> opCounters;
+
+// global variable: mutex protecting opCounters
+std::mutex opCountersMutex;
+
+// global variable: ticks per second of stats_ticks()
+double statsTicksPerSec = 1e9;
+
+// global variable: reporter thread
+std::atomic<bool> statsReporterRunning;
+std::thread statsReporterThread;
+
+#if !defined(YSB_NO_STATS)
+
+/**
+ *  \brief Function to get the counters of the calling thread
+ *
+ *  This function returns the array of counters of the calling thread, which
+ *  is created and registered at the first call.
+ */
+static inline op_counters_t *my_op_counters()
+{
+    static thread_local op_counters_t *counters = nullptr;
+    if (counters == nullptr) {
+        if (posix_memalign((void **) &counters, 64, OP_NUM_KINDS * sizeof(op_counters_t)) != 0) abort();
+        for (size_t k=0; k<OP_NUM_KINDS; k++)
+            new (&counters[k]) op_counters_t();
+        std::lock_guard<std::mutex> lock(opCountersMutex);
+        opCounters.push_back(counters);
+    }
+    return counters;
+}
+
+// add n to a counter of the calling thread (the only writer)
+static inline void stats_bump(std::atomic<uint64_t> &c, uint64_t n)
+{
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// account n tuples received by an operator
+static inline void stats_in(op_kind_t kind, uint64_t n)
+{
+    stats_bump(my_op_counters()[kind].in, n);
+}
+
+// account n tuples produced by an operator
+static inline void stats_out(op_kind_t kind, uint64_t n)
+{
+    stats_bump(my_op_counters()[kind].out, n);
+}
+
+// Timer of an invocation of an operator (from construction to destruction). One
+// invocation every STATS_SAMPLE_CALLS is timed and accounted for all of them.
+// The timers of a thread form a stack: the time of an operator invoked inline
+// by another one (e.g., the drain of a shuffle or the sink run by the window)
+// is subtracted from the busy time of the outer operator
+class OpTimer
+{
+private:
+    op_counters_t &counters;
+    OpTimer *parent; // timer of the operator invoking this one inline (nullptr if none)
+    bool sampled; // true if the invocation is accounted in counters
+    uint64_t start; // zero if the invocation is not timed (for itself or for the parent)
+    uint64_t nested; // ticks spent in the operators invoked inline
+
+    // innermost timer of the calling thread
+    static OpTimer *&current()
+    {
+        static thread_local OpTimer *timer = nullptr;
+        return timer;
+    }
+
+public:
+    // constructor
+    OpTimer(op_kind_t kind): counters(my_op_counters()[kind]), parent(current()), nested(0)
+    {
+        sampled = (counters.calls.load(std::memory_order_relaxed) % STATS_SAMPLE_CALLS == 0);
+        start = (sampled || (parent != nullptr && parent->start != 0)) ? stats_ticks() : 0;
+        current() = this;
+    }
+
+    // destructor
+    ~OpTimer()
+    {
+        if (start != 0) {
+            uint64_t elapsed = stats_ticks() - start;
+            if (sampled)
+                stats_bump(counters.busy, (elapsed - nested) * STATS_SAMPLE_CALLS);
+            if (parent != nullptr && parent->start != 0)
+                parent->nested += elapsed;
+        }
+        stats_bump(counters.calls, 1);
+        current() = parent;
+    }
+};
+
+#else
+
+// instrumentation removed at compile time
+static inline void stats_in(op_kind_t, uint64_t) {}
+static inline void stats_out(op_kind_t, uint64_t) {}
+
+// Timer of an invocation of an operator (removed at compile time)
+class OpTimer
+{
+public:
+    // constructor
+    OpTimer(op_kind_t) {}
+};
+
+#endif
+
+// merge the counters of all the threads
+static inline vector<op_totals_t> merged_op_stats()
+{
+    vector<op_totals_t> totals(OP_NUM_KINDS);
+    std::lock_guard<std::mutex> lock(opCountersMutex);
+    for (auto counters: opCounters) {
+        for (size_t k=0; k<OP_NUM_KINDS; k++) {
+            uint64_t calls = counters[k].calls.load(std::memory_order_relaxed);
+            totals[k].in += counters[k].in.load(std::memory_order_relaxed);
+            totals[k].out += counters[k].out.load(std::memory_order_relaxed);
+            totals[k].calls += calls;
+            totals[k].busy += counters[k].busy.load(std::memory_order_relaxed);
+            totals[k].threads += (calls > 0);
+        }
+    }
+    return totals;
+}
+
+// global variable: totals discarded from the report of the whole run (e.g., the warm-up)
+vector<op_totals_t> opStatsBaseline;
+
+// global variable: mutex protecting opStatsBaseline
+std::mutex opStatsBaselineMutex;
+
+// discard the totals of the operators accounted so far from the report of the whole run
+static inline void discard_op_stats()
+{
+    vector<op_totals_t> totals = merged_op_stats();
+    std::lock_guard<std::mutex> lock(opStatsBaselineMutex);
+    opStatsBaseline = totals;
+}
+
+// print the rates and the utilization of the operators in an interval of sec seconds
+static inline void print_op_interval(double t, double sec, const vector<op_totals_t> &prev, const vector<op_totals_t> &cur)
+{
+    cout << "[Stats] " << fixed << setprecision(1) << t << " s";
+    int last = -1; // last active operator (the lane is not in the chain)
+    for (size_t k=0; k<OP_NUM_KINDS; k++) {
+        if (cur[k].in + cur[k].out + cur[k].calls == 0)
+            continue;
+        double cores = (cur[k].busy - prev[k].busy) / statsTicksPerSec / sec;
+        cout << " | " << op_kind_name((op_kind_t) k) << setprecision(0);
+        if (k != OP_SOURCE && k != OP_LANE)
+            cout << " in " << (cur[k].in - prev[k].in) / sec << "/s";
+        if (k != OP_SINK && k != OP_LANE)
+            cout << " out " << (cur[k].out - prev[k].out) / sec << "/s";
+        if (cur[k].calls > 0) // not timed if fused in the lane
+            cout << " busy " << setprecision(2) << cores;
+        if (k == OP_LANE)
+            continue;
+        // tuples produced by the previous operator and not yet received
+        if (last >= 0 && cur[last].out >= cur[k].in)
+            cout << " queued " << cur[last].out - cur[k].in;
+        last = k;
+    }
+    cout << defaultfloat << setprecision(6) << endl;
+}
+
+/**
+ *  \brief Function to start the reporter thread
+ *
+ *  This function calibrates the cycle counter and, if interval_sec is positive,
+ *  starts the thread printing the statistics of the operators every
+ *  interval_sec seconds.
+ */
+static inline void stats_start(unsigned int interval_sec)
+{
+#if defined(YSB_HAS_TSC)
+    uint64_t tsc0 = stats_ticks();
+    unsigned long usec0 = current_time_usecs();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    statsTicksPerSec = (stats_ticks() - tsc0) * 1000000.0 / (current_time_usecs() - usec0);
+#endif
+#if defined(YSB_NO_STATS)
+    interval_sec = 0; // nothing to report
+#endif
+    statsReporterRunning = (interval_sec > 0);
+    if (interval_sec == 0)
+        return;
+    statsReporterThread = std::thread([interval_sec] () {
+        unsigned long start_us = current_time_usecs();
+        unsigned long last_us = start_us;
+        vector<op_totals_t> prev = merged_op_stats();
+        while (statsReporterRunning.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            unsigned long now_us = current_time_usecs();
+            if (now_us - last_us < interval_sec * 1000000ul)
+                continue;
+            vector<op_totals_t> cur = merged_op_stats();
+            print_op_interval((now_us - start_us) / 1000000.0, (now_us - last_us) / 1000000.0, prev, cur);
+            prev = cur;
+            last_us = now_us;
+        }
+    });
+}
+
+// stop the reporter thread
+static inline void stats_stop()
+{
+    if (statsReporterRunning) {
+        statsReporterRunning = false;
+        statsReporterThread.join();
+    }
+}
+
+// print the breakdown of the whole run per operator
+static inline void print_op_stats()
+{
+#if !defined(YSB_NO_STATS)
+    vector<op_totals_t> totals = merged_op_stats();
+    {
+        std::lock_guard<std::mutex> lock(opStatsBaselineMutex);
+        if (!opStatsBaseline.empty()) {
+            cout << "[Main] Operator statistics after the warm-up" << endl;
+            for (size_t k=0; k<OP_NUM_KINDS; k++) {
+                totals[k].in -= opStatsBaseline[k].in;
+                totals[k].out -= opStatsBaseline[k].out;
+                totals[k].calls -= opStatsBaseline[k].calls;
+                totals[k].busy -= opStatsBaseline[k].busy;
+            }
+        }
+    }
+    for (size_t k=0; k<OP_NUM_KINDS; k++) {
+        const op_totals_t &t = totals[k];
+        if (t.in + t.out + t.calls == 0)
+            continue;
+        double busy_sec = t.busy / statsTicksPerSec;
+        cout << "[Main] Operator " << op_kind_name((op_kind_t) k);
+        if (k != OP_SOURCE && k != OP_LANE)
+            cout << " in " << t.in;
+        if (k != OP_SINK && k != OP_LANE)
+            cout << " out " << t.out;
+        if (k != OP_SOURCE && k != OP_SINK && t.in > 0)
+            cout << " (selectivity " << ((double) t.out) / t.in << ")";
+        if (t.calls == 0) {
+            cout << " (timed in the lane)" << endl;
+            continue;
+        }
+        cout << " busy " << busy_sec << " s in " << t.calls << " calls on " << t.threads << " threads";
+        uint64_t n = (t.in > 0) ? t.in : t.out;
+        if (n > 0)
+            cout << " (" << busy_sec * 1e9 / n << " ns per tuple)";
+        cout << endl;
+    }
+#else
+    cout << "[Main] Operator statistics disabled at compile time" << endl;
+#endif
+}
+
+#endif
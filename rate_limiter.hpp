@@ -0,0 +1,126 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Rate control of the sources of the Yahoo! Streaming Benchmark
+ *
+ *  A rate-limited source is open-loop: tokens accrue according to the offered
+ *  load profile independently of how fast the pipeline consumes the events,
+ *  and each event is stamped with its intended send time, i.e. the time at
+ *  which its token became available. A source which falls behind schedule
+ *  spends the accumulated tokens at full speed without moving the schedule,
+ *  so queueing delays show up in the latencies (no coordinated omission).
+ */
+
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+// include
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+
+using namespace std;
+
+// Offered load of a source over time
+struct RateProfile
+{
+    enum kind_t { UNLIMITED, CONSTANT, STEP, RAMP };
+
+    kind_t kind;
+    double rate; // events/sec at the beginning
+    double rate2; // events/sec after the step or at the end of the ramp
+    double at_sec; // time of the step or duration of the ramp
+
+    // constructor
+    RateProfile(): kind(UNLIMITED), rate(0), rate2(0), at_sec(0) {}
+
+    // get the rate (events/sec) at a given time from the start
+    double rate_at(double t_sec) const
+    {
+        switch (kind) {
+            case STEP: return (t_sec < at_sec) ? rate : rate2;
+            case RAMP: return (t_sec < at_sec) ? rate + (rate2 - rate) * (t_sec / at_sec) : rate2;
+            default: return rate;
+        }
+    }
+
+    // check whether the profile limits the rate
+    bool limited() const
+    {
+        return kind != UNLIMITED;
+    }
+};
+
+/**
+ *  \brief Function to parse a rate profile
+ *
+ *  This function builds the profile of a source from its initial rate (0 means
+ *  unlimited) and an optional shape "step:[rate]:[sec]" (the rate changes to
+ *  [rate] after [sec] seconds) or "ramp:[rate]:[sec]" (the rate changes
+ *  linearly to [rate] in [sec] seconds). It returns false if the shape is not
+ *  valid.
+ */
+static inline bool parse_rate_profile(double rate, const string &shape, RateProfile &profile)
+{
+    profile = RateProfile();
+    profile.rate = rate;
+    profile.kind = (rate > 0) ? RateProfile::CONSTANT : RateProfile::UNLIMITED;
+    if (shape.empty())
+        return true;
+    size_t p1 = shape.find(':');
+    size_t p2 = (p1 == string::npos) ? string::npos : shape.find(':', p1 + 1);
+    if (p2 == string::npos || rate <= 0)
+        return false;
+    string kind = shape.substr(0, p1);
+    if (kind == "step")
+        profile.kind = RateProfile::STEP;
+    else if (kind == "ramp")
+        profile.kind = RateProfile::RAMP;
+    else
+        return false;
+    profile.rate2 = atof(shape.substr(p1 + 1, p2 - p1 - 1).c_str());
+    profile.at_sec = atof(shape.substr(p2 + 1).c_str());
+    return profile.rate2 > 0 && profile.at_sec > 0;
+}
+
+// Token bucket pacing the events of a source
+class RateLimiter
+{
+private:
+    RateProfile profile;
+    double next_token_us; // time (usec from the start) at which the next token becomes available
+
+public:
+    // constructor
+    RateLimiter(const RateProfile &_profile=RateProfile()): profile(_profile), next_token_us(0) {}
+
+    // check whether the source is paced
+    bool limited() const
+    {
+        return profile.limited();
+    }
+
+    // take the next token, returning its intended send time (usec from the start)
+    inline uint64_t acquire()
+    {
+        uint64_t intended_us = (uint64_t) next_token_us;
+        next_token_us += 1000000.0 / profile.rate_at(next_token_us / 1000000.0);
+        return intended_us;
+    }
+};
+
+#endif
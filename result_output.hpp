@@ -0,0 +1,358 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Output of the window results of the Yahoo! Streaming Benchmark
+ *
+ *  Each operator emitting results (sinks, window workers or the merge) has its
+ *  own channel serializing the results in a large buffer, as binary records,
+ *  CSV lines or JSON lines. A full buffer is queued to the writer thread and
+ *  replaced by a free one (double buffering), so the operators never wait for
+ *  the I/O: if the writer is behind and no buffer is free a new one is
+ *  allocated. The writer writes the buffers to a file, a named pipe or a unix
+ *  socket (target unix:path), and gives them back to the free list.
+ */
+
+#ifndef RESULT_OUTPUT_H
+#define RESULT_OUTPUT_H
+
+// include
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+#include <condition_variable>
+#include <ysb_clock.hpp>
+
+using namespace std;
+
+// formats of the results
+enum output_format_t { OUTPUT_BINARY, OUTPUT_CSV, OUTPUT_JSON };
+
+// record of a result in the binary format
+struct output_record_t
+{
+    uint64_t wid; // window id (start time for sessions)
+    uint64_t cmp_id; // campaign id
+    uint64_t ts; // timestamp of the last event of the window
+    uint64_t count; // events of the window
+};
+
+// parse the format of the results (binary, csv or json)
+static inline bool parse_output_format(const string &spec, output_format_t &format)
+{
+    if (spec == "binary")
+        format = OUTPUT_BINARY;
+    else if (spec == "csv")
+        format = OUTPUT_CSV;
+    else if (spec == "json")
+        format = OUTPUT_JSON;
+    else
+        return false;
+    return true;
+}
+
+// get the name of a format of the results
+static inline const char *output_format_name(output_format_t format)
+{
+    return (format == OUTPUT_BINARY) ? "binary" : ((format == OUTPUT_CSV) ? "csv" : "json");
+}
+
+class ResultWriter;
+
+// Channel of an operator emitting results (used by one thread at a time)
+class ResultChannel
+{
+private:
+    static const size_t MAX_RECORD = 128; // longest serialized result
+
+    ResultWriter *writer;
+    output_format_t format;
+    char *buf; // buffer being filled
+    size_t len; // bytes in the buffer
+    size_t capacity; // size of the buffers
+    uint64_t results; // serialized results
+
+    friend class ResultWriter;
+
+    // append a decimal number
+    inline void put_uint(uint64_t v)
+    {
+        char tmp[20];
+        size_t n = 0;
+        do {
+            tmp[n++] = '0' + (v % 10);
+            v /= 10;
+        } while (v != 0);
+        while (n > 0)
+            buf[len++] = tmp[--n];
+    }
+
+    // append a string
+    inline void put_str(const char *s, size_t n)
+    {
+        memcpy(buf + len, s, n);
+        len += n;
+    }
+
+    // queue the buffer to the writer and get a free one
+    inline void flush();
+
+public:
+    // constructor
+    ResultChannel(ResultWriter *_writer, output_format_t _format, char *_buf, size_t _capacity):
+                  writer(_writer), format(_format), buf(_buf), len(0), capacity(_capacity), results(0) {}
+
+    // serialize a result
+    inline void write(uint64_t wid, uint64_t cmp_id, uint64_t ts, uint64_t count)
+    {
+        if (len + MAX_RECORD > capacity)
+            flush();
+        switch (format) {
+            case OUTPUT_BINARY: {
+                output_record_t rec = { wid, cmp_id, ts, count };
+                put_str((const char *) &rec, sizeof(rec));
+                break;
+            }
+            case OUTPUT_CSV:
+                put_uint(wid); buf[len++] = ',';
+                put_uint(cmp_id); buf[len++] = ',';
+                put_uint(ts); buf[len++] = ',';
+                put_uint(count); buf[len++] = '\n';
+                break;
+            default:
+                put_str("{\"wid\":", 7); put_uint(wid);
+                put_str(",\"cmp_id\":", 10); put_uint(cmp_id);
+                put_str(",\"ts\":", 6); put_uint(ts);
+                put_str(",\"count\":", 9); put_uint(count);
+                put_str("}\n", 2);
+        }
+        results++;
+    }
+};
+
+// Writer of the results (owns the channels and the I/O thread)
+class ResultWriter
+{
+private:
+    // buffer waiting to be written
+    struct pending_t
+    {
+        char *buf;
+        size_t len;
+    };
+
+    string target; // file, named pipe or unix:path
+    output_format_t format;
+    size_t buffer_bytes; // size of the buffers
+    int fd;
+    bool is_socket;
+    vector<ResultChannel *> channels;
+    std::mutex mutex;
+    std::condition_variable cond;
+    deque<pending_t> queue; // buffers waiting to be written
+    vector<char *> free_list; // buffers written (or never used)
+    size_t num_buffers; // allocated buffers
+    bool stopping;
+    std::thread io;
+    bool failed; // true after a write error (the next buffers are dropped)
+    uint64_t bytes; // bytes written (used by the I/O thread)
+    uint64_t dropped; // bytes dropped after an error
+    uint64_t writes; // buffers written
+    uint64_t write_us; // time spent in the writes
+    size_t max_queued; // longest queue of buffers
+
+    // allocate a buffer (the lock is held)
+    char *new_buffer()
+    {
+        char *b = nullptr;
+        if (posix_memalign((void **) &b, 64, buffer_bytes) != 0) abort();
+        num_buffers++;
+        return b;
+    }
+
+    // write a buffer to the target
+    void write_buffer(const pending_t &p)
+    {
+        if (failed) {
+            dropped += p.len;
+            return;
+        }
+        unsigned long start_us = current_time_usecs();
+        size_t done = 0;
+        while (done < p.len) {
+            ssize_t w = is_socket ? send(fd, p.buf + done, p.len - done, MSG_NOSIGNAL) : ::write(fd, p.buf + done, p.len - done);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0) {
+                cerr << "[Output] Cannot write to " << target << " (" << strerror(errno) << "), the next results are dropped" << endl;
+                failed = true;
+                dropped += p.len - done;
+                break;
+            }
+            done += w;
+        }
+        bytes += done;
+        writes++;
+        write_us += current_time_usecs() - start_us;
+    }
+
+    // queue a full buffer and get a free one (called by the channels)
+    char *exchange(char *buf, size_t len)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(pending_t{ buf, len });
+        max_queued = (queue.size() > max_queued) ? queue.size() : max_queued;
+        cond.notify_one();
+        if (free_list.empty())
+            return new_buffer();
+        char *b = free_list.back();
+        free_list.pop_back();
+        return b;
+    }
+
+    friend class ResultChannel;
+
+public:
+    // constructor (the target is opened by open)
+    ResultWriter(const string &_target, output_format_t _format, size_t _buffer_bytes=(1 << 20)):
+                 target(_target), format(_format), buffer_bytes(_buffer_bytes), fd(-1), is_socket(false), num_buffers(0),
+                 stopping(false), failed(false), bytes(0), dropped(0), writes(0), write_us(0), max_queued(0) {}
+
+    // destructor
+    ~ResultWriter()
+    {
+        stop();
+        for (auto c: channels) {
+            free(c->buf);
+            delete c;
+        }
+        for (auto b: free_list)
+            free(b);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    // open the target (appending to a file if append is true) and start the I/O thread
+    bool open(bool append=false)
+    {
+        if (target.compare(0, 5, "unix:") == 0) {
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (target.size() - 5 >= sizeof(addr.sun_path))
+                return false;
+            strcpy(addr.sun_path, target.c_str() + 5);
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0)
+                return false;
+            is_socket = true;
+        }
+        else {
+            // a named pipe blocks here until its reader is connected
+            fd = ::open(target.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+            if (fd < 0)
+                return false;
+            signal(SIGPIPE, SIG_IGN); // a closed pipe is reported by write
+        }
+        io = std::thread([this] () {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                cond.wait(lock, [this] () { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                pending_t p = queue.front();
+                queue.pop_front();
+                lock.unlock();
+                write_buffer(p); // only the I/O thread touches the target
+                lock.lock();
+                free_list.push_back(p.buf);
+            }
+        });
+        return true;
+    }
+
+    // create the channel of an operator (before the graph is started)
+    ResultChannel *channel()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ResultChannel *c = new ResultChannel(this, format, new_buffer(), buffer_bytes);
+        channels.push_back(c);
+        free_list.push_back(new_buffer()); // second buffer of the channel
+        return c;
+    }
+
+    // write the partially filled buffers and stop the I/O thread (after the graph is over)
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping || !io.joinable())
+                return;
+            for (auto c: channels) {
+                if (c->len > 0) {
+                    queue.push_back(pending_t{ c->buf, c->len });
+                    c->buf = nullptr; // freed with the free list
+                    c->len = 0;
+                }
+            }
+            stopping = true;
+        }
+        cond.notify_one();
+        io.join();
+    }
+
+    // get the number of written results (after stop)
+    uint64_t results() const
+    {
+        uint64_t n = 0;
+        for (auto c: channels)
+            n += c->results;
+        return n;
+    }
+
+    // print the statistics of the output (after stop)
+    void report() const
+    {
+        cout << "[Main] Output " << results() << " results (" << output_format_name(format) << ", " << bytes << " bytes) to " << target
+             << " in " << writes << " writes (writer " << write_us / 1000.0 << " ms, " << num_buffers << " buffers of "
+             << buffer_bytes / 1024 << " KB, max queued " << max_queued << ")";
+        if (failed)
+            cout << ", " << dropped << " bytes dropped after an error";
+        cout << endl;
+    }
+};
+
+// queue the buffer to the writer and get a free one
+inline void ResultChannel::flush()
+{
+    buf = writer->exchange(buf, len);
+    len = 0;
+}
+
+#endif
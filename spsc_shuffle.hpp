@@ -0,0 +1,239 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Key-partitioned shuffle of the Yahoo! Streaming Benchmark
+ *
+ *  The joins (producers) and the window workers (consumers) are connected by
+ *  an N x M mesh of lock-free single-producer/single-consumer ring buffers,
+ *  replacing the try_put() on the serial window nodes. A consumer has no task
+ *  of its own: after a push, the producer tries to acquire the consumer and,
+ *  if it succeeds, drains all its inbound rings in batches. A consumer is run
+ *  by one thread at a time, and the items of each producer are consumed in
+ *  FIFO order.
+ */
+
+#ifndef SPSC_SHUFFLE_H
+#define SPSC_SHUFFLE_H
+
+// include
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <functional>
+
+using namespace std;
+
+// kinds of shuffle between the joins and the window workers
+enum shuffle_mode_t { SHUFFLE_TBB, SHUFFLE_SPSC };
+
+// get the name of a shuffle mode
+static inline const char *shuffle_mode_name(shuffle_mode_t mode)
+{
+    return (mode == SHUFFLE_SPSC) ? "spsc" : "tbb";
+}
+
+// parse the name of a shuffle mode (returns false if unknown)
+static inline bool parse_shuffle_mode(const string &name, shuffle_mode_t &mode)
+{
+    if (name == "tbb") mode = SHUFFLE_TBB;
+    else if (name == "spsc") mode = SHUFFLE_SPSC;
+    else return false;
+    return true;
+}
+
+// Single-producer/single-consumer ring buffer
+template<typename T>
+class SPSCRing
+{
+private:
+    // the fields of the consumer and of the producer are in different cache lines
+    char padding0[64];
+    std::atomic<size_t> head; // next position to read (written by the consumer)
+    size_t cached_tail; // last tail seen by the consumer
+    char padding1[64];
+    std::atomic<size_t> tail; // next position to write (written by the producer)
+    size_t cached_head; // last head seen by the producer
+    char padding2[64];
+    size_t mask;
+    vector<T> slots;
+
+public:
+    // constructor (the capacity is rounded up to a power of two)
+    SPSCRing(size_t _capacity=1024): head(0), cached_tail(0), tail(0), cached_head(0)
+    {
+        size_t capacity = 1;
+        while (capacity < _capacity)
+            capacity <<= 1;
+        mask = capacity - 1;
+        slots.resize(capacity);
+    }
+
+    // insert an item (returns false if the ring is full)
+    inline bool push(const T &item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head > mask) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head > mask)
+                return false;
+        }
+        slots[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // extract up to max items (returns the number of extracted items)
+    inline size_t pop_batch(T *out, size_t max)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (cached_tail == h) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (cached_tail == h)
+                return 0;
+        }
+        size_t n = (cached_tail - h < max) ? cached_tail - h : max;
+        for (size_t i=0; i<n; i++)
+            out[i] = slots[(h + i) & mask];
+        head.store(h + n, std::memory_order_release);
+        return n;
+    }
+
+    // check whether the ring is empty (called by the consumer)
+    inline bool empty() const
+    {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+    }
+};
+
+// Mesh of SPSC rings between N producers and M consumers
+template<typename T>
+class ShuffleMesh
+{
+private:
+    static const size_t DRAIN_BATCH = 64; // items popped from a ring at a time
+
+    // state of a consumer
+    struct consumer_t
+    {
+        std::atomic<bool> busy; // true while a thread is draining the consumer
+        function<void(T)> process; // function applied to the items
+        char padding[64]; // the flags of two consumers are in different cache lines
+
+        // constructor
+        consumer_t(): busy(false) {}
+    };
+
+    size_t n_producers;
+    size_t n_consumers;
+    vector<SPSCRing<T> *> rings; // ring of producer p to consumer c in position p * n_consumers + c
+    vector<consumer_t> consumers;
+
+    // check whether some inbound ring of a consumer is not empty
+    inline bool pending(size_t c) const
+    {
+        for (size_t p=0; p<n_producers; p++) {
+            if (!rings[p * n_consumers + c]->empty())
+                return true;
+        }
+        return false;
+    }
+
+public:
+    // constructor
+    ShuffleMesh(size_t _n_producers, size_t _n_consumers, size_t _ring_capacity=1024):
+                n_producers(_n_producers), n_consumers(_n_consumers), consumers(_n_consumers)
+    {
+        for (size_t i=0; i<n_producers * n_consumers; i++)
+            rings.push_back(new SPSCRing<T>(_ring_capacity));
+    }
+
+    // destructor
+    ~ShuffleMesh()
+    {
+        for (auto r: rings)
+            delete r;
+    }
+
+    // set the function run by a consumer on its items
+    void setConsumer(size_t c, function<void(T)> process)
+    {
+        consumers[c].process = process;
+    }
+
+    // get the number of consumers
+    size_t numConsumers() const
+    {
+        return n_consumers;
+    }
+
+    // send an item from producer p to consumer c, and drain c if it is idle
+    inline void push(size_t p, size_t c, const T &item)
+    {
+        SPSCRing<T> &ring = *rings[p * n_consumers + c];
+        while (!ring.push(item)) {
+            // ring full: drain the consumer or wait for the thread draining it
+            if (!try_drain(c))
+                std::this_thread::yield();
+        }
+        try_drain(c);
+    }
+
+    /**
+     *  \brief Method to drain a consumer
+     *
+     *  This method drains all the inbound rings of consumer c if no other
+     *  thread is doing it, and returns false otherwise. The seq_cst fences
+     *  guarantee that an item pushed while another thread holds the consumer
+     *  is seen by that thread after the release, which drains again.
+     */
+    inline bool try_drain(size_t c)
+    {
+        consumer_t &consumer = consumers[c];
+        bool drained = false;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!consumer.busy.load(std::memory_order_relaxed) && !consumer.busy.exchange(true, std::memory_order_acquire)) {
+            T items[DRAIN_BATCH];
+            bool found = true;
+            while (found) {
+                found = false;
+                for (size_t p=0; p<n_producers; p++) {
+                    size_t n = rings[p * n_consumers + c]->pop_batch(items, DRAIN_BATCH);
+                    for (size_t i=0; i<n; i++)
+                        consumer.process(items[i]);
+                    found = found || (n > 0);
+                }
+            }
+            consumer.busy.store(false, std::memory_order_release);
+            drained = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!pending(c))
+                break;
+        }
+        return drained;
+    }
+
+    // drain all the consumers (to be called when all the producers are done)
+    void drain_all()
+    {
+        for (size_t c=0; c<n_consumers; c++)
+            try_drain(c);
+    }
+};
+
+#endif
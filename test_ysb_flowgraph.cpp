@@ -42,6 +42,18 @@ extern volatile unsigned long start_time_usec;
 // global variable: number of generated events
 extern atomic<long> sentCounter;
 
+// global variable: true if tuples are allocated from the per-thread pools
+extern bool use_pool_allocator;
+
+// global variable: number of slabs allocated by all the pools
+extern atomic<long> poolSlabs;
+
+// global variable: number of events pre-aggregated by all the combiners
+extern atomic<long> combinedEvents;
+
+// global variable: number of partials shipped by all the combiners
+extern atomic<long> shippedPartials;
+
 // main
 int main(int argc, char *argv[])
 {
@@ -50,14 +62,32 @@ int main(int argc, char *argv[])
     size_t pardegree1 = 1;
     size_t pardegree2 = 1;
     int TBBThreads = -1;
+    join_index_t join_kind = JOIN_AUTO;
+    double rate = 0;
+    string rate_shape;
+    RateProfile rate_profile;
+    clock_mode_t clock_mode = CLOCK_MODE_SYSCALL;
+    shuffle_mode_t shuffle_mode = SHUFFLE_TBB;
+    int numa_nodes = -1;
+    size_t num_campaigns = 100;
+    unsigned int ads_per_campaign = 10;
+    AdDistribution ad_dist;
+    WindowSpec win_spec;
+    bool fused = false;
+    bool combine = false;
+    long combine_slice = 0;
+    unsigned int stats_interval = 0;
+    unsigned long warmup_sec = 0;
+    string output_target;
+    output_format_t output_format = OUTPUT_CSV;
     // initialize global sentCounter
     sentCounter = 0;
     // arguments from command line
     if (argc < 7) {
-	   cout << argv[0] << " -l [execution_seconds] -n [par_degree] -m [par_degree] [-t numTBBThreads]" << endl;
+	   cout << argv[0] << " -l [execution_seconds] -n [par_degree] -m [par_degree] [-t numTBBThreads] [-p] [-j auto|hash|direct|flat] [-r events/sec per source] [-R step|ramp:rate:sec] [-c syscall|tsc|batch|coarse] [-s tbb|spsc] [-N auto|num_nodes] [-C campaigns] [-A ads per campaign] [-d uniform|zipf:s|hot:frac:prob] [-w tumbling:ms|sliding:ms:ms|session:ms] [-f] [-g combiner slice usec] [-S stats interval sec] [-o output file|pipe|unix:socket] [-O binary|csv|json] [-W warm-up sec]" << endl;
 	   exit(EXIT_SUCCESS);
     }
-    while ((option = getopt(argc, argv, "l:n:m:t:")) != -1) {
+    while ((option = getopt(argc, argv, "l:n:m:t:pj:r:R:c:s:N:C:A:d:w:fg:S:o:O:W:")) != -1) {
     	switch (option) {
         	case 'l': exec_time_sec = atoi(optarg);
         	    break;
@@ -67,84 +97,312 @@ int main(int argc, char *argv[])
         	    break;
         	case 't': TBBThreads = atoi(optarg);
         	    break;
+        	case 'p': use_pool_allocator = true;
+        	    break;
+        	case 'f': fused = true;
+        	    break;
+        	case 'g': combine = true;
+        	    combine_slice = atol(optarg);
+        	    break;
+        	case 'S': stats_interval = atoi(optarg);
+        	    break;
+        	case 'W': warmup_sec = atol(optarg);
+        	    break;
+        	case 'o': output_target = optarg;
+        	    break;
+        	case 'O': {
+        	    if (!parse_output_format(optarg, output_format)) {
+        	        cout << "[Main] Output format " << optarg << " not available" << endl;
+        	        exit(EXIT_FAILURE);
+        	    }
+        	    break;
+        	}
+        	case 'r': rate = atof(optarg);
+        	    break;
+        	case 'R': rate_shape = optarg;
+        	    break;
+        	case 'c': {
+        	    if (!parse_clock_mode(optarg, clock_mode)) {
+        	        cout << "[Main] Clock mode " << optarg << " not available" << endl;
+        	        exit(EXIT_FAILURE);
+        	    }
+        	    break;
+        	}
+        	case 's': {
+        	    if (!parse_shuffle_mode(optarg, shuffle_mode)) {
+        	        cout << "[Main] Shuffle " << optarg << " not available" << endl;
+        	        exit(EXIT_FAILURE);
+        	    }
+        	    break;
+        	}
+        	case 'N': {
+        	    numa_nodes = (string(optarg) == "auto") ? 0 : atoi(optarg);
+        	    if (numa_nodes <= 0 && string(optarg) != "auto") {
+        	        cout << "[Main] Number of NUMA nodes " << optarg << " not valid" << endl;
+        	        exit(EXIT_FAILURE);
+        	    }
+        	    break;
+        	}
+        	case 'C': num_campaigns = atol(optarg);
+        	    break;
+        	case 'A': ads_per_campaign = atoi(optarg);
+        	    break;
+        	case 'd': {
+        	    if (!parse_ad_distribution(optarg, ad_dist)) {
+        	        cout << "[Main] Ad distribution " << optarg << " not valid" << endl;
+        	        exit(EXIT_FAILURE);
+        	    }
+        	    break;
+        	}
+        	case 'w': {
+        	    if (!parse_window_spec(optarg, win_spec)) {
+        	        cout << "[Main] Windows " << optarg << " not valid" << endl;
+        	        exit(EXIT_FAILURE);
+        	    }
+        	    break;
+        	}
+        	case 'j': {
+        	    if (!parse_join_index(optarg, join_kind)) {
+        	        cout << "[Main] Join index " << optarg << " not available" << endl;
+        	        exit(EXIT_FAILURE);
+        	    }
+        	    break;
+        	}
         	default: {
-        	    cout << argv[0] << " -l [execution_seconds] -n [par_degree] -m [par_degree] [-t numTBBThreads]" << endl;
+        	    cout << argv[0] << " -l [execution_seconds] -n [par_degree] -m [par_degree] [-t numTBBThreads] [-p] [-j auto|hash|direct|flat] [-r events/sec per source] [-R step|ramp:rate:sec] [-c syscall|tsc|batch|coarse] [-s tbb|spsc] [-N auto|num_nodes] [-C campaigns] [-A ads per campaign] [-d uniform|zipf:s|hot:frac:prob] [-w tumbling:ms|sliding:ms:ms|session:ms] [-f] [-g combiner slice usec] [-S stats interval sec] [-o output file|pipe|unix:socket] [-O binary|csv|json] [-W warm-up sec]" << endl;
         	    exit(EXIT_SUCCESS);
         	}
         }
     }
+    if (win_spec.kind == WindowSpec::SLIDING) {
+        cout << "[Main] Sliding windows need the batched version" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (combine && win_spec.kind == WindowSpec::SESSION) {
+        cout << "[Main] The combiner needs tumbling or sliding windows" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (combine && combine_slice <= 0) {
+        cout << "[Main] Time slice of the combiner must be positive" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (warmup_sec > 0 && warmup_sec >= exec_time_sec) {
+        cout << "[Main] Warm-up must be shorter than the execution time" << endl;
+        exit(EXIT_FAILURE);
+    }
+#if defined(YSB_COMPACT_TUPLES)
+    if (exec_time_sec * 1000000 >= COMPACT_TS_LIMIT) {
+        cout << "[Main] Execution time must be at most " << (COMPACT_TS_LIMIT - 1) / 1000000 << " sec with the compact tuples" << endl;
+        exit(EXIT_FAILURE);
+    }
+#endif
+    if (num_campaigns == 0 || ads_per_campaign == 0) {
+        cout << "[Main] Number of campaigns and of ads per campaign must be positive" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!parse_rate_profile(rate, rate_shape, rate_profile)) {
+        cout << "[Main] Rate profile " << rate_shape << " not valid" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!clock_init(clock_mode)) {
+        cout << "[Main] Clock mode " << clock_mode_name(clock_mode) << " not supported by this machine" << endl;
+        exit(EXIT_FAILURE);
+    }
+    // open the output of the results (a named pipe waits here for its reader)
+    ResultWriter *writer = nullptr;
+    if (!output_target.empty()) {
+        writer = new ResultWriter(output_target, output_format);
+        if (!writer->open()) {
+            cout << "[Main] Cannot open the output " << output_target << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
     // initialize TBB environment
-    tbb::task_scheduler_init init((TBBThreads > 0) ? TBBThreads : tbb::task_scheduler_init::default_num_threads());
-    // create the campaigns
-    CampaignGenerator campaign_gen;
-    // the application graph
-    graph g;
+    int num_threads = (TBBThreads > 0) ? TBBThreads : tbb::task_scheduler_init::default_num_threads();
+    tbb::task_scheduler_init init(num_threads);
+    // place the operators on the NUMA nodes (a single node if disabled)
+    NumaPlacement placement;
+    if (numa_nodes >= 0)
+        placement.init(numa_nodes, num_threads);
+    size_t num_nodes = placement.numNodes();
+    // create the campaigns (the join index is replicated on each node)
+    CampaignGenerator campaign_gen(num_campaigns, ads_per_campaign, join_kind);
+    vector<JoinIndex *> join_indexes;
+    for (size_t k=0; k<num_nodes; k++)
+        join_indexes.push_back(placement.replicate(campaign_gen.getJoinIndex(), k));
+    // create the shuffle between joins and window workers (if not done by the TBB nodes)
+    ShuffleMesh<joined_event_t *> *shuffle = nullptr;
+    if (shuffle_mode == SHUFFLE_SPSC)
+        shuffle = new ShuffleMesh<joined_event_t *>(pardegree1, pardegree2);
+    // the application graphs: each node has a graph with its sources, filters and
+    // joins, and a graph with its window workers and sinks waited for after them
+    vector<graph *> left_graphs;
+    vector<graph *> right_graphs;
+    for (size_t k=0; k<num_nodes; k++) {
+        placement.execute(k, [&] () {
+            left_graphs.push_back(new graph());
+            right_graphs.push_back(new graph());
+        });
+    }
     // create the TBB FlowGraph nodes (left part)
     vector<source_node_t *> sources;
     vector<filter_node_t *> filters;
     vector<map_node_t *> maps;
+    vector<lane_node_t *> lanes;
+    vector<lane_end_node_t *> lane_ends;
     vector<window_node_t *> workers;
+    vector<WinAggregate *> aggregates;
     vector<sink_node_t *> sinks;
     for(size_t i=0; i<pardegree1; ++i) {
-    	// create source
-    	auto source = new source_node_t(g, YSBSource(exec_time_sec, campaign_gen.getArrays(), campaign_gen.getAdsCompaign()));
-    	assert(source);
-    	sources.push_back(source);
-    	// create filter
-    	auto filter = new filter_node_t(g, unlimited, YSBFilter());
-    	assert(filter);
-    	filters.push_back(filter);
-    	// create the flat-map
-    	auto join = new map_node_t(g, unlimited, YSBJoin(workers, campaign_gen.getHashMap(), campaign_gen.getRelationalTable()));
-    	assert(join);
-    	maps.push_back(join);
+    	size_t k = i % num_nodes;
+    	graph &g = *left_graphs[k];
+    	placement.execute(k, [&] () {
+    		YSBSource source_body(exec_time_sec, campaign_gen.getArrays(), AdSampler(ad_dist, campaign_gen.getNumAds(), i), rate_profile);
+    		YSBJoin join_body(i, workers, *join_indexes[k], shuffle, combine ? win_spec.pane() : 0, combine_slice);
+    		if (fused) {
+    			// create the fused lane (inactive until all the nodes are connected)
+    			auto lane = new lane_node_t(g, YSBFusedLane(source_body, YSBFilter(), join_body), false);
+    			assert(lane);
+    			lanes.push_back(lane);
+    			auto lane_end = new lane_end_node_t(g, unlimited, [] (continue_msg) { return continue_msg(); });
+    			assert(lane_end);
+    			lane_ends.push_back(lane_end);
+    			return;
+    		}
+    		// create source (inactive until all the nodes are connected)
+    		auto source = new source_node_t(g, source_body, false);
+    		assert(source);
+    		sources.push_back(source);
+    		// create filter
+    		auto filter = new filter_node_t(g, unlimited, YSBFilter());
+    		assert(filter);
+    		filters.push_back(filter);
+    		// create the flat-map (serial if it is the single producer of its rings or it has a combiner)
+    		auto join = new map_node_t(g, (shuffle != nullptr || combine) ? 1 : unlimited, join_body);
+    		assert(join);
+    		maps.push_back(join);
+    	});
     }
     // create the TBB FlowGraph nodes (right part)
     for(size_t i=0; i<pardegree2; ++i) {
-    	// create the aggregation
-    	auto aggregation = new window_node_t(g, 1, WinAggregate(i, pardegree1));
-    	assert(aggregation);
-    	workers.push_back(aggregation);
-    	// create the sink
-    	auto sink = new sink_node_t(g, 1, YSBSink());
-    	assert(sink);
-    	sinks.push_back(sink);
+    	size_t k = i % num_nodes;
+    	graph &g = *right_graphs[k];
+    	numaWorkerNode.push_back(k);
+    	placement.execute(k, [&] () {
+    		// create the sink
+    		auto sink = new sink_node_t(g, 1, YSBSink((writer != nullptr) ? writer->channel() : nullptr));
+    		assert(sink);
+    		sinks.push_back(sink);
+    		// create the aggregation (a node, or a consumer of the shuffle sending to the sink)
+    		if (shuffle != nullptr) {
+    			auto aggregation = new WinAggregate(i, pardegree1, win_spec);
+    			aggregates.push_back(aggregation);
+    			std::tuple<sink_node_t &> ports(*sink);
+    			shuffle->setConsumer(i, [aggregation, ports] (joined_event_t *in) mutable { (*aggregation)(in, ports); });
+    		}
+    		else {
+    			auto aggregation = new window_node_t(g, 1, WinAggregate(i, pardegree1, win_spec));
+    			assert(aggregation);
+    			workers.push_back(aggregation);
+    		}
+    	});
     }
     // create the connections between nodes
-    for(size_t i=0; i<pardegree1; ++i) {
+    for(size_t i=0; i<sources.size(); ++i) {
     	make_edge(*sources[i], *filters[i]);
     	make_edge(*filters[i], *maps[i]);
     }
-    for(size_t i=0; i<pardegree2; ++i) {
+    for(size_t i=0; i<lanes.size(); ++i)
+    	make_edge(*lanes[i], *lane_ends[i]);
+    for(size_t i=0; i<workers.size(); ++i) {
 	   make_edge (*workers[i], *sinks[i]);
     }
+    // start the reporter of the operator statistics (every stats_interval seconds)
+    stats_start(stats_interval);
+    // sample the throughput of every second (the warm-up is excluded from the steady state)
+    ThroughputSampler sampler(warmup_sec, exec_time_sec);
     // initialize global start_time_usec
     volatile unsigned long start_time_main_us = current_time_usecs();
-    start_time_usec = start_time_main_us;
+    start_time_usec = now_usecs(); // in the time domain of the timestamp service
+    long start_allocs = AllocCounter::total();
+    long start_slabs = poolSlabs;
+    sampler.start();
     // starting all sources
-    for(size_t i=0; i<pardegree1; ++i)
+    for(size_t i=0; i<sources.size(); ++i)
 	   sources[i]->activate();
-    // waiting for termination
-    g.wait_for_all();
+    for(size_t i=0; i<lanes.size(); ++i)
+	   lanes[i]->activate();
+    // waiting for termination (the joins are done before the window workers)
+    for(size_t k=0; k<num_nodes; ++k)
+	   left_graphs[k]->wait_for_all();
+    sampler.stop(); // the sources are over
+    for(size_t k=0; k<num_nodes; ++k)
+	   right_graphs[k]->wait_for_all();
+    long run_allocs = AllocCounter::total() - start_allocs;
+    long run_slabs = poolSlabs - start_slabs; // the slabs of the pools are not allocated by operator new
+    stats_stop();
+    if (writer != nullptr)
+        writer->stop(); // write the last results
     // final statistics
     volatile unsigned long end_time_main_us = current_time_usecs();
     double elapsed_time_sec = (end_time_main_us - start_time_main_us) / (1000000.0);
     unsigned long rcvResults  = 0;
+    vector<size_t> workerLoad;
     for(size_t i=0; i<pardegree2; ++i) {
 	   auto body = copy_body<YSBSink, sink_node_t>(*sinks[i]);
 	   rcvResults  += body.rcvResults();
+	   WinAggregate aggregation = (shuffle != nullptr) ? *aggregates[i] : copy_body<WinAggregate, window_node_t>(*workers[i]);
+	   workerLoad.push_back(aggregation.processedTuples());
     }
     cout << "[Main] Total generated messages are " << sentCounter << endl;
     cout << "[Main] Total received results are " << rcvResults << endl;
+    cout << "[Main] Throughput " << sentCounter/elapsed_time_sec << ((warmup_sec > 0) ? " (whole run, warm-up included)" : "") << endl;
+    sampler.report();
     cout << "[Main] Total elapsed time (seconds) " << elapsed_time_sec << endl;
-    for(size_t i=0; i<pardegree1; ++i) {
+    if (AllocCounter::enabled)
+        cout << "[Main] Heap allocations " << run_allocs << " by operator new (" << ((sentCounter > 0) ? 1000.0 * run_allocs / sentCounter : 0)
+             << " per 1000 events) and " << run_slabs << " pool slabs" << endl;
+    if (rate_profile.limited())
+        cout << "[Main] Offered load " << pardegree1 * rate_profile.rate_at(0) << " -> " << pardegree1 * rate_profile.rate_at(exec_time_sec) << " events/sec" << endl;
+    print_latency("Tuple", merged_latency(LAT_TUPLE));
+    print_latency("Result", merged_latency(LAT_RESULT));
+    clock_report();
+    clock_shutdown();
+    cout << "[Main] Campaigns " << num_campaigns << " with " << ads_per_campaign << " ads each (" << ad_distribution_name(ad_dist) << ")" << endl;
+    cout << "[Main] Windows " << window_spec_name(win_spec) << endl;
+    cout << "[Main] Join index " << join_index_name(campaign_gen.getJoinIndex().getKind()) << endl;
+    cout << "[Main] Shuffle " << shuffle_mode_name(shuffle_mode) << endl;
+    cout << "[Main] Source, filter and join " << (fused ? "fused" : "separate nodes") << endl;
+    numa_report();
+    print_worker_load(workerLoad);
+    print_op_stats();
+    if (writer != nullptr)
+        writer->report();
+    if (combine)
+        print_combiner_report();
+    if (use_pool_allocator)
+        cout << "[Main] Pool allocator used " << poolSlabs << " slabs (" << run_slabs << " allocated during the run)" << endl;
+    for(size_t i=0; i<sources.size(); ++i) {
 	   delete sources[i];
 	   delete filters[i];
 	   delete maps[i];
     }
-    for(size_t i=0; i<pardegree2; ++i) {
+    for(size_t i=0; i<lanes.size(); ++i) {
+	   delete lanes[i];
+	   delete lane_ends[i];
+    }
+    for(size_t i=0; i<workers.size(); ++i)
 	   delete workers[i];
+    for(size_t i=0; i<aggregates.size(); ++i)
+	   delete aggregates[i];
+    for(size_t i=0; i<pardegree2; ++i)
 	   delete sinks[i];
+    delete shuffle;
+    for(size_t k=0; k<num_nodes; ++k) {
+	   delete left_graphs[k];
+	   delete right_graphs[k];
+	   delete join_indexes[k];
     }
+    delete writer;
     return 0;
 }
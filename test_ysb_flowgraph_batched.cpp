@@ -41,6 +41,18 @@ extern volatile unsigned long start_time_usec;
 // global variable: number of generated events
 extern atomic<long> sentCounter;
 
+// global variable: true if tuples are allocated from the per-thread pools
+extern bool use_pool_allocator;
+
+// global variable: number of slabs allocated by all the pools
+extern atomic<long> poolSlabs;
+
+// global variable: number of events pre-aggregated by all the combiners
+extern atomic<long> combinedEvents;
+
+// global variable: number of partials shipped by all the combiners
+extern atomic<long> shippedPartials;
+
 // main
 int main(int argc, char *argv[])
 {
@@ -49,15 +61,39 @@ int main(int argc, char *argv[])
     size_t pardegree1 = 1;
     size_t pardegree2 = 1;
     int TBBThreads = -1;
+    join_index_t join_kind = JOIN_AUTO;
+    double rate = 0;
+    string rate_shape;
+    RateProfile rate_profile;
+    clock_mode_t clock_mode = CLOCK_MODE_SYSCALL;
+    shuffle_mode_t shuffle_mode = SHUFFLE_TBB;
+    int numa_nodes = -1;
+    size_t num_campaigns = 100;
+    unsigned int ads_per_campaign = 10;
+    AdDistribution ad_dist;
+    WindowSpec win_spec;
     size_t batch_len = 1;
+    size_t split = 1;
+    long target_latency = 0;
+    bool combine = false;
+    long combine_slice = 0;
+    unsigned int stats_interval = 0;
+    unsigned long warmup_sec = 0;
+    string checkpoint_dir;
+    long checkpoint_interval = 1000;
+    bool resume = false;
+    string replay_file;
+    string output_target;
+    output_format_t output_format = OUTPUT_CSV;
+    filter_isa_t filter_isa = best_filter_isa();
     // initialize global sentCounter
     sentCounter = 0;
     // arguments from command line
     if (argc < 9) {
-	   cout << argv[0] << " -l [execution_seconds] -n [par_degree] -m [par_degree] [-t numTBBThreads] -b [batch len]" << endl;
+	   cout << argv[0] << " -l [execution_seconds] -n [par_degree] -m [par_degree] [-t numTBBThreads] -b [batch len] [-p] [-j auto|hash|direct|flat] [-r events/sec per source] [-R step|ramp:rate:sec] [-c syscall|tsc|batch|coarse] [-x scalar|avx2|avx512] [-s tbb|spsc] [-N auto|num_nodes] [-C campaigns] [-A ads per campaign] [-d uniform|zipf:s|hot:frac:prob] [-w tumbling:ms|sliding:ms:ms|session:ms] [-k split hot keys] [-B target latency usec (adaptive batches)] [-H] [-g combiner slice usec] [-S stats interval sec] [-K checkpoint dir] [-I checkpoint interval ms] [-Y (resume from the latest checkpoint)] [-i event log to replay] [-o output file|pipe|unix:socket] [-O binary|csv|json] [-W warm-up sec]" << endl;
 	   exit(EXIT_SUCCESS);
     }
-    while ((option = getopt(argc, argv, "l:n:m:t:b:")) != -1) {
+    while ((option = getopt(argc, argv, "l:n:m:t:b:px:j:r:R:c:s:N:C:A:d:w:k:B:Hg:S:K:I:Yi:o:O:W:")) != -1) {
     	switch (option) {
         	case 'l': exec_time_sec = atoi(optarg);
         	    break;
@@ -67,79 +103,451 @@ int main(int argc, char *argv[])
         	    break;
         	case 't': TBBThreads = atoi(optarg);
         	    break;
+        	case 'p': use_pool_allocator = true;
+        	    break;
+        	case 'H': recycle_batches = false;
+        	    break;
+        	case 'g': combine = true;
+        	    combine_slice = atol(optarg);
+        	    break;
+        	case 'S': stats_interval = atoi(optarg);
+        	    break;
+        	case 'W': warmup_sec = atol(optarg);
+        	    break;
+        	case 'K': checkpoint_dir = optarg;
+        	    break;
+        	case 'I': checkpoint_interval = atol(optarg);
+        	    break;
+        	case 'Y': resume = true;
+        	    break;
+        	case 'i': replay_file = optarg;
+        	    break;
+        	case 'o': output_target = optarg;
+        	    break;
+        	case 'O': {
+        	    if (!parse_output_format(optarg, output_format)) {
+        	        cout << "[Main] Output format " << optarg << " not available" << endl;
+        	        exit(EXIT_FAILURE);
+        	    }
+        	    break;
+        	}
+        	case 'r': rate = atof(optarg);
+        	    break;
+        	case 'R': rate_shape = optarg;
+        	    break;
+        	case 'c': {
+        	    if (!parse_clock_mode(optarg, clock_mode)) {
+        	        cout << "[Main] Clock mode " << optarg << " not available" << endl;
+        	        exit(EXIT_FAILURE);
+        	    }
+        	    break;
+        	}
+        	case 's': {
+        	    if (!parse_shuffle_mode(optarg, shuffle_mode)) {
+        	        cout << "[Main] Shuffle " << optarg << " not available" << endl;
+        	        exit(EXIT_FAILURE);
+        	    }
+        	    break;
+        	}
+        	case 'N': {
+        	    numa_nodes = (string(optarg) == "auto") ? 0 : atoi(optarg);
+        	    if (numa_nodes <= 0 && string(optarg) != "auto") {
+        	        cout << "[Main] Number of NUMA nodes " << optarg << " not valid" << endl;
+        	        exit(EXIT_FAILURE);
+        	    }
+        	    break;
+        	}
+        	case 'k': split = atoi(optarg);
+        	    break;
+        	case 'C': num_campaigns = atol(optarg);
+        	    break;
+        	case 'A': ads_per_campaign = atoi(optarg);
+        	    break;
+        	case 'd': {
+        	    if (!parse_ad_distribution(optarg, ad_dist)) {
+        	        cout << "[Main] Ad distribution " << optarg << " not valid" << endl;
+        	        exit(EXIT_FAILURE);
+        	    }
+        	    break;
+        	}
+        	case 'w': {
+        	    if (!parse_window_spec(optarg, win_spec)) {
+        	        cout << "[Main] Windows " << optarg << " not valid" << endl;
+        	        exit(EXIT_FAILURE);
+        	    }
+        	    break;
+        	}
+        	case 'j': {
+        	    if (!parse_join_index(optarg, join_kind)) {
+        	        cout << "[Main] Join index " << optarg << " not available" << endl;
+        	        exit(EXIT_FAILURE);
+        	    }
+        	    break;
+        	}
+        	case 'x': {
+        	    if (!parse_filter_isa(optarg, filter_isa) || !filter_isa_supported(filter_isa)) {
+        	        cout << "[Main] Filter kernel " << optarg << " not available" << endl;
+        	        exit(EXIT_FAILURE);
+        	    }
+        	    break;
+        	}
             case 'b': batch_len = atoi(optarg);
                 break;
+            case 'B': target_latency = atol(optarg);
+                break;
         	default: {
-        	    cout << argv[0] << " -l [execution_seconds] -n [par_degree] -m [par_degree] [-t numTBBThreads] -b [batch len]" << endl;
+        	    cout << argv[0] << " -l [execution_seconds] -n [par_degree] -m [par_degree] [-t numTBBThreads] -b [batch len] [-p] [-j auto|hash|direct|flat] [-r events/sec per source] [-R step|ramp:rate:sec] [-c syscall|tsc|batch|coarse] [-x scalar|avx2|avx512] [-s tbb|spsc] [-N auto|num_nodes] [-C campaigns] [-A ads per campaign] [-d uniform|zipf:s|hot:frac:prob] [-w tumbling:ms|sliding:ms:ms|session:ms] [-k split hot keys] [-B target latency usec (adaptive batches)] [-H] [-g combiner slice usec] [-S stats interval sec] [-K checkpoint dir] [-I checkpoint interval ms] [-Y (resume from the latest checkpoint)] [-i event log to replay] [-o output file|pipe|unix:socket] [-O binary|csv|json] [-W warm-up sec]" << endl;
         	    exit(EXIT_SUCCESS);
         	}
         }
     }
+    if (split == 0 || split > pardegree2) {
+        cout << "[Main] Hot keys can be split among 1 to " << pardegree2 << " workers" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (batch_len == 0 || target_latency < 0) {
+        cout << "[Main] Batch length and target latency must be positive" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (split > 1 && win_spec.kind == WindowSpec::SESSION) {
+        cout << "[Main] Hot keys cannot be split with session windows" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (combine && win_spec.kind == WindowSpec::SESSION) {
+        cout << "[Main] The combiner needs tumbling or sliding windows" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (combine && combine_slice <= 0) {
+        cout << "[Main] Time slice of the combiner must be positive" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (checkpoint_dir.empty() && resume) {
+        cout << "[Main] Resuming needs the checkpoint directory" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!checkpoint_dir.empty() && (split > 1 || checkpoint_interval <= 0)) {
+        cout << "[Main] Checkpoints need a positive interval and hot keys not split" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!checkpoint_dir.empty() && !replay_file.empty()) {
+        cout << "[Main] Checkpoints need the generated events (no replay)" << endl;
+        exit(EXIT_FAILURE);
+    }
+    // map the event log to replay (it gives the campaigns of the relational table)
+    EventLog event_log;
+    if (!replay_file.empty()) {
+        if (!event_log.open(replay_file)) {
+            cout << "[Main] Event log " << replay_file << " not valid" << endl;
+            exit(EXIT_FAILURE);
+        }
+        num_campaigns = event_log.numCampaigns();
+        ads_per_campaign = event_log.adsPerCampaign();
+    }
+    if (warmup_sec > 0 && warmup_sec >= exec_time_sec) {
+        cout << "[Main] Warm-up must be shorter than the execution time" << endl;
+        exit(EXIT_FAILURE);
+    }
+#if defined(YSB_COMPACT_TUPLES)
+    if (exec_time_sec * 1000000 >= COMPACT_TS_LIMIT) {
+        cout << "[Main] Execution time must be at most " << (COMPACT_TS_LIMIT - 1) / 1000000 << " sec with the compact tuples" << endl;
+        exit(EXIT_FAILURE);
+    }
+#endif
+    if (num_campaigns == 0 || ads_per_campaign == 0) {
+        cout << "[Main] Number of campaigns and of ads per campaign must be positive" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!parse_rate_profile(rate, rate_shape, rate_profile)) {
+        cout << "[Main] Rate profile " << rate_shape << " not valid" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!clock_init(clock_mode)) {
+        cout << "[Main] Clock mode " << clock_mode_name(clock_mode) << " not supported by this machine" << endl;
+        exit(EXIT_FAILURE);
+    }
+    // open the output of the results, appended to the file if resuming (a named
+    // pipe waits here for its reader)
+    ResultWriter *writer = nullptr;
+    if (!output_target.empty()) {
+        writer = new ResultWriter(output_target, output_format);
+        if (!writer->open(resume)) {
+            cout << "[Main] Cannot open the output " << output_target << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
     // initialize TBB environment
-    tbb::task_scheduler_init init((TBBThreads > 0) ? TBBThreads : tbb::task_scheduler_init::default_num_threads());
-    // create the campaigns
-    CampaignGenerator campaign_gen;
-    // the application graph
-    graph g;
+    int num_threads = (TBBThreads > 0) ? TBBThreads : tbb::task_scheduler_init::default_num_threads();
+    tbb::task_scheduler_init init(num_threads);
+    // place the operators on the NUMA nodes (a single node if disabled)
+    NumaPlacement placement;
+    if (numa_nodes >= 0)
+        placement.init(numa_nodes, num_threads);
+    size_t num_nodes = placement.numNodes();
+    // create the campaigns (the join index is replicated on each node)
+    CampaignGenerator campaign_gen(num_campaigns, ads_per_campaign, join_kind);
+    vector<JoinIndex *> join_indexes;
+    for (size_t k=0; k<num_nodes; k++)
+        join_indexes.push_back(placement.replicate(campaign_gen.getJoinIndex(), k));
+    // create the shuffle between joins and window workers (if not done by the TBB nodes)
+    ShuffleMesh<joined_batch_t *> *shuffle = nullptr;
+    if (shuffle_mode == SHUFFLE_SPSC)
+        shuffle = new ShuffleMesh<joined_batch_t *>(pardegree1, pardegree2, 256);
+    // the application graphs: each node has a graph with its sources, filters and
+    // joins, and a graph with its window workers waited for after them. The merge
+    // of the partial windows (if hot keys are split) has its own graph, waited last
+    vector<graph *> left_graphs;
+    vector<graph *> right_graphs;
+    for (size_t k=0; k<num_nodes; k++) {
+        placement.execute(k, [&] () {
+            left_graphs.push_back(new graph());
+            right_graphs.push_back(new graph());
+        });
+    }
+    graph *merge_graph = nullptr;
+    merge_node_batched_t *merge = nullptr;
+    if (split > 1) {
+        placement.execute(0, [&] () {
+            merge_graph = new graph();
+            merge = new merge_node_batched_t(*merge_graph, 1, WinMergeBatched(pardegree2, win_spec, (writer != nullptr) ? writer->channel() : nullptr));
+        });
+    }
+    // create the store of the checkpoints (one part per source and per window worker)
+    // and find the checkpoint to resume from (the state of the operators is restored
+    // before creating their nodes)
+    CheckpointStore *store = nullptr;
+    uint64_t resume_epoch = 0;
+    uint64_t resume_ts = 0;
+    size_t resumed_events = 0;
+    unsigned long restore_us = 0;
+    if (!checkpoint_dir.empty())
+        store = new CheckpointStore(checkpoint_dir, checkpoint_interval * 1000, pardegree1 + pardegree2);
+    if (resume && !store->latest(resume_epoch)) {
+        cout << "[Main] No complete checkpoint in " << checkpoint_dir << endl;
+        exit(EXIT_FAILURE);
+    }
+    CheckpointBuffer extra;
+    if (resume && store->load(resume_epoch, "worker-" + to_string(pardegree2), extra)) {
+        cout << "[Main] Checkpoint " << resume_epoch << " was taken with more window workers" << endl;
+        exit(EXIT_FAILURE);
+    }
     // create the TBB FlowGraph nodes (left part)
     vector<source_node_batched_t *> sources;
     vector<filter_node_batched_t *> filters;
     vector<map_node_batched_t *> maps;
     vector<window_node_batched_t *> workers;
+    vector<WinAggregateBatched *> aggregates;
+    vector<AdaptiveBatcher *> batchers;
     for(size_t i=0; i<pardegree1; ++i) {
-    	// create source
-    	auto source = new source_node_batched_t(g, YSBSourceBatched(exec_time_sec, campaign_gen.getArrays(), campaign_gen.getAdsCompaign(), batch_len));
-    	assert(source);
-    	sources.push_back(source);
-    	// create filter
-    	auto filter = new filter_node_batched_t(g, unlimited, YSBFilterBatched());
-    	assert(filter);
-    	filters.push_back(filter);
-    	// create the flat-map
-    	auto join = new map_node_batched_t(g, unlimited, YSBJoinBatched(workers, campaign_gen.getHashMap(), campaign_gen.getRelationalTable()));
-    	assert(join);
-    	maps.push_back(join);
+    	size_t k = i % num_nodes;
+    	graph &g = *left_graphs[k];
+    	placement.execute(k, [&] () {
+    		// create the controller of the batch length (if adaptive, -b is the initial length)
+    		AdaptiveBatcher *batcher = nullptr;
+    		if (target_latency > 0) {
+    			batcher = new AdaptiveBatcher(target_latency, batch_len);
+    			batchers.push_back(batcher);
+    		}
+    		// create source (inactive until all the nodes are connected)
+    		source_node_batched_t *source = nullptr;
+    		if (!replay_file.empty())
+    			source = new source_node_batched_t(g, YSBReplaySourceBatched(exec_time_sec, event_log, i, pardegree1, batch_len, rate_profile, batcher), false);
+    		else {
+    			source_workload_t workload(ad_dist, num_campaigns, ads_per_campaign);
+    			YSBSourceBatched body(exec_time_sec, campaign_gen.getArrays(), AdSampler(ad_dist, campaign_gen.getNumAds(), i), batch_len, rate_profile, batcher, store, i, workload);
+    			if (resume) {
+    				unsigned long start_us = current_time_usecs();
+    				CheckpointBuffer buf;
+    				uint64_t ts = 0;
+    				source_workload_t saved;
+    				bool loaded = store->load(resume_epoch, "source-" + to_string(i), buf);
+    				if (!loaded || !body.restore(buf, ts, saved)) {
+    					if (loaded && saved.num_campaigns > 0 && !(saved == workload))
+    						cout << "[Main] Checkpoint " << resume_epoch << " was taken with -d " << ad_distribution_name(saved.dist) << " -C " << saved.num_campaigns
+    						     << " -A " << saved.ads_per_campaign << ", it cannot be resumed with -d " << ad_distribution_name(ad_dist) << " -C " << num_campaigns
+    						     << " -A " << ads_per_campaign << endl;
+    					else
+    						cout << "[Main] Checkpoint " << resume_epoch << " has no valid state for source " << i << endl;
+    					exit(EXIT_FAILURE);
+    				}
+    				resume_ts = std::max(resume_ts, ts);
+    				resumed_events += body.sentEvents();
+    				restore_us += current_time_usecs() - start_us;
+    			}
+    			source = new source_node_batched_t(g, body, false);
+    		}
+    		assert(source);
+    		sources.push_back(source);
+    		// create filter (filter and join are serial to keep the batches of a source in order)
+    		auto filter = new filter_node_batched_t(g, 1, YSBFilterBatched(0, filter_isa, batcher));
+    		assert(filter);
+    		filters.push_back(filter);
+    		// create the flat-map
+    		auto join = new map_node_batched_t(g, 1, YSBJoinBatched(i, workers, *join_indexes[k], shuffle, split, batcher, combine ? win_spec.pane() : 0, combine_slice));
+    		assert(join);
+    		maps.push_back(join);
+    	});
     }
     // create the TBB FlowGraph nodes (right part)
     for(size_t i=0; i<pardegree2; ++i) {
-    	// create the aggregation
-    	auto aggregation = new window_node_batched_t(g, 1, WinAggregateBatched(i, pardegree1));
-    	assert(aggregation);
-    	workers.push_back(aggregation);
+    	size_t k = i % num_nodes;
+    	graph &g = *right_graphs[k];
+    	numaWorkerNode.push_back(k);
+    	placement.execute(k, [&] () {
+    		// create the aggregation (a node, or a consumer of the shuffle sending to the merge if any)
+    		WinAggregateBatched body(i, pardegree1, win_spec, merge != nullptr, store, (writer != nullptr && merge == nullptr) ? writer->channel() : nullptr);
+    		if (resume) {
+    			unsigned long start_us = current_time_usecs();
+    			CheckpointBuffer buf;
+    			if (!store->load(resume_epoch, "worker-" + to_string(i), buf) || !body.restore(buf)) {
+    				cout << "[Main] Checkpoint " << resume_epoch << " has no valid state for window worker " << i << endl;
+    				exit(EXIT_FAILURE);
+    			}
+    			restore_us += current_time_usecs() - start_us;
+    		}
+    		if (shuffle != nullptr) {
+    			auto aggregation = new WinAggregateBatched(body);
+    			aggregates.push_back(aggregation);
+    			if (merge != nullptr) {
+    				std::tuple<merge_node_batched_t &> ports(*merge);
+    				shuffle->setConsumer(i, [aggregation, ports] (joined_batch_t *in) mutable { (*aggregation)(in, ports); });
+    			}
+    			else
+    				shuffle->setConsumer(i, [aggregation] (joined_batch_t *in) { std::tuple<> ports; (*aggregation)(in, ports); });
+    		}
+    		else {
+    			auto aggregation = new window_node_batched_t(g, 1, body);
+    			assert(aggregation);
+    			workers.push_back(aggregation);
+    		}
+    	});
+    }
+#if defined(YSB_COMPACT_TUPLES)
+    // the event time of a resumed run continues from the checkpoint
+    if (exec_time_sec * 1000000 + resume_ts >= COMPACT_TS_LIMIT) {
+        cout << "[Main] Execution time plus the event time of the checkpoint (" << resume_ts / 1000000 << " sec) must be at most "
+             << (COMPACT_TS_LIMIT - 1) / 1000000 << " sec with the compact tuples" << endl;
+        exit(EXIT_FAILURE);
     }
+#endif
     // create the connections between nodes
     for(size_t i=0; i<pardegree1; ++i) {
     	make_edge(*sources[i], *filters[i]);
     	make_edge(*filters[i], *maps[i]);
     }
+    for(size_t i=0; i<workers.size() && merge != nullptr; ++i) {
+	   make_edge(*workers[i], *merge);
+    }
+    // start the reporter of the operator statistics (every stats_interval seconds)
+    stats_start(stats_interval);
+    // sample the throughput of every second (the warm-up is excluded from the steady state)
+    ThroughputSampler sampler(warmup_sec, exec_time_sec);
     // initialize global start_time_usec
     volatile unsigned long start_time_main_us = current_time_usecs();
-    start_time_usec = start_time_main_us;
+    start_time_usec = now_usecs() - resume_ts; // in the time domain of the timestamp service (continued if resumed)
+    long start_allocs = AllocCounter::total();
+    long start_slabs = poolSlabs;
+    sampler.start();
     // starting all sources
     for(size_t i=0; i<pardegree1; ++i)
 	   sources[i]->activate();
-    // waiting for termination
-    g.wait_for_all();
+    // waiting for termination (the joins are done before the window workers)
+    for(size_t k=0; k<num_nodes; ++k)
+	   left_graphs[k]->wait_for_all();
+    sampler.stop(); // the sources are over
+    for(size_t k=0; k<num_nodes; ++k)
+	   right_graphs[k]->wait_for_all();
+    if (merge_graph != nullptr)
+	   merge_graph->wait_for_all();
+    long run_allocs = AllocCounter::total() - start_allocs;
+    long run_slabs = poolSlabs - start_slabs; // the slabs of the pools are not allocated by operator new
+    stats_stop();
+    if (store != nullptr)
+        store->stop();
+    if (writer != nullptr)
+        writer->stop(); // write the last results
     // final statistics
     volatile unsigned long end_time_main_us = current_time_usecs();
     double elapsed_time_sec = (end_time_main_us - start_time_main_us) / (1000000.0);
     unsigned long rcvResults  = 0;
+    unsigned long lateEvents = 0;
+    unsigned long maxOpenWindows = 0;
+    vector<size_t> workerLoad;
     for(size_t i=0; i<pardegree2; ++i) {
-	    auto body = copy_body<WinAggregateBatched, window_node_batched_t>(*workers[i]);
+	    WinAggregateBatched body = (shuffle != nullptr) ? *aggregates[i] : copy_body<WinAggregateBatched, window_node_batched_t>(*workers[i]);
 	    rcvResults  += body.rcvResults();
+	    lateEvents += body.lateEvents();
+	    maxOpenWindows = std::max(maxOpenWindows, (unsigned long) body.maxOpenWindows());
+	    workerLoad.push_back(body.processedTuples());
+    }
+    size_t mergedWindows = 0;
+    if (merge != nullptr) {
+	    auto body = copy_body<WinMergeBatched, merge_node_batched_t>(*merge);
+	    rcvResults = body.rcvResults();
+	    mergedWindows = body.mergedWindows();
     }
     cout << "[Main] Total generated messages are " << sentCounter << endl;
     cout << "[Main] Total received results are " << rcvResults << endl;
-    cout << "[Main] Throughput " << sentCounter/elapsed_time_sec << endl;
+    cout << "[Main] Throughput " << (sentCounter - resumed_events)/elapsed_time_sec << ((warmup_sec > 0) ? " (whole run, warm-up included)" : "") << endl;
+    sampler.report();
+    cout << "[Main] Max open windows per worker " << maxOpenWindows << " (late events " << lateEvents << ")" << endl;
     cout << "[Main] Total elapsed time (seconds) " << elapsed_time_sec << endl;
+    if (AllocCounter::enabled)
+        cout << "[Main] Heap allocations " << run_allocs << " by operator new (" << ((sentCounter > 0) ? 1000.0 * run_allocs / sentCounter : 0)
+             << " per 1000 events) and " << run_slabs << " pool slabs" << endl;
+    if (rate_profile.limited())
+        cout << "[Main] Offered load " << pardegree1 * rate_profile.rate_at(0) << " -> " << pardegree1 * rate_profile.rate_at(exec_time_sec) << " events/sec" << endl;
+    print_latency("Tuple", merged_latency(LAT_TUPLE));
+    print_latency("Result", merged_latency(LAT_RESULT));
+    clock_report();
+    clock_shutdown();
+    cout << "[Main] Campaigns " << num_campaigns << " with " << ads_per_campaign << " ads each (" << (replay_file.empty() ? ad_distribution_name(ad_dist) : "replayed") << ")" << endl;
+    if (!replay_file.empty())
+        cout << "[Main] Replayed log " << replay_file << " (" << event_log.numEvents() << " events in " << event_log.numBlocks() << " blocks)" << endl;
+    cout << "[Main] Windows " << window_spec_name(win_spec) << endl;
+    cout << "[Main] Join index " << join_index_name(campaign_gen.getJoinIndex().getKind()) << endl;
+    cout << "[Main] Filter kernel " << filter_isa_name(filter_isa) << endl;
+    cout << "[Main] Shuffle " << shuffle_mode_name(shuffle_mode) << endl;
+    numa_report();
+    print_worker_load(workerLoad);
+    print_op_stats();
+    if (merge != nullptr)
+        cout << "[Main] Hot keys split among " << split << " workers (" << mergedWindows << " partial windows merged)" << endl;
+    if (!batchers.empty())
+        print_batch_lengths(batchers);
+    if (combine)
+        print_combiner_report();
+    if (!recycle_batches)
+        cout << "[Main] Batches allocated on the heap (not recycled)" << endl;
+    if (use_pool_allocator || recycle_batches)
+        cout << "[Main] Pool allocator used " << poolSlabs << " slabs (" << run_slabs << " allocated during the run)" << endl;
+    if (resume)
+        cout << "[Main] Resumed from checkpoint " << resume_epoch << " at event time " << resume_ts / 1000000.0 << " sec (" << resumed_events
+             << " events generated before, state restored in " << restore_us / 1000.0 << " ms)" << endl;
+    if (store != nullptr)
+        store->report();
+    if (writer != nullptr)
+        writer->report();
     // delete all the created nodes/operators
     for(size_t i=0; i<pardegree1; ++i) {
 	   delete sources[i];
 	   delete filters[i];
 	   delete maps[i];
     }
-    for(size_t i=0; i<pardegree2; ++i) {
+    for(size_t i=0; i<workers.size(); ++i)
 	   delete workers[i];
+    for(size_t i=0; i<aggregates.size(); ++i)
+	   delete aggregates[i];
+    for(size_t i=0; i<batchers.size(); ++i)
+	   delete batchers[i];
+    delete shuffle;
+    delete store;
+    delete writer;
+    delete merge;
+    delete merge_graph;
+    for(size_t k=0; k<num_nodes; ++k) {
+	   delete left_graphs[k];
+	   delete right_graphs[k];
+	   delete join_indexes[k];
     }
     return 0;
 }
@@ -0,0 +1,193 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Steady-state throughput of the Yahoo! Streaming Benchmark
+ *
+ *  The sources publish the number of generated events in per-thread counters
+ *  (every few events in the per-tuple version, every batch in the batched
+ *  one). A sampler thread reads them at the end of every second of the run
+ *  and keeps the rate of each second (the last one is scaled if the sources
+ *  end during it). The seconds of the warm-up are excluded from the steady
+ *  state, and the latencies, the totals of the operators and the counters of
+ *  the combiners accounted during the warm-up are discarded. The
+ *  steady-state throughput is the mean of the remaining seconds, with their
+ *  spread and the change from the first to the last third of the run (e.g.,
+ *  a degradation caused by the growth of the state).
+ */
+
+#ifndef THROUGHPUT_SAMPLER_H
+#define THROUGHPUT_SAMPLER_H
+
+// include
+#include <new>
+#include <cmath>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <condition_variable>
+#include <combiner.hpp>
+#include <operator_stats.hpp>
+#include <latency_histogram.hpp>
+
+using namespace std;
+
+// counter of the events generated by a thread (written only by the thread)
+struct alignas(64) generated_counter_t
+{
+    std::atomic<uint64_t> events;
+
+    // constructor
+    generated_counter_t(): events(0) {}
+};
+
+// global variable: per-thread counters of the generated events
+vector<generated_counter_t *> generatedCounters;
+
+// global variable: mutex protecting generatedCounters
+std::mutex generatedCountersMutex;
+
+// account n events generated by the calling thread
+static inline void count_generated(uint64_t n)
+{
+    static thread_local generated_counter_t *counter = nullptr;
+    if (counter == nullptr) {
+        if (posix_memalign((void **) &counter, 64, sizeof(generated_counter_t)) != 0) abort();
+        new (counter) generated_counter_t();
+        std::lock_guard<std::mutex> lock(generatedCountersMutex);
+        generatedCounters.push_back(counter);
+    }
+    counter->events.store(counter->events.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// get the events generated by all the threads
+static inline uint64_t total_generated()
+{
+    uint64_t total = 0;
+    std::lock_guard<std::mutex> lock(generatedCountersMutex);
+    for (auto counter: generatedCounters)
+        total += counter->events.load(std::memory_order_relaxed);
+    return total;
+}
+
+// Sampler of the throughput of every second of the run
+class ThroughputSampler
+{
+private:
+    unsigned long warmup_sec; // seconds excluded from the steady state
+    unsigned long exec_time_sec; // seconds sampled at most
+    vector<double> rates; // events/sec of each second
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool stopping;
+    std::thread sampler;
+
+public:
+    // constructor
+    ThroughputSampler(unsigned long _warmup_sec, unsigned long _exec_time_sec):
+                      warmup_sec(_warmup_sec), exec_time_sec(_exec_time_sec), stopping(false) {}
+
+    // destructor
+    ~ThroughputSampler()
+    {
+        stop();
+    }
+
+    // start sampling (when the sources are activated)
+    void start()
+    {
+        sampler = std::thread([this] () {
+            auto start = std::chrono::steady_clock::now();
+            uint64_t last = total_generated();
+            std::unique_lock<std::mutex> lock(mutex);
+            for (unsigned long k=1; k<=exec_time_sec; k++) {
+                if (cond.wait_until(lock, start + std::chrono::seconds(k), [this] () { return stopping; })) {
+                    // the sources ended during this second: its rate is kept if it is long enough
+                    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() - (k - 1);
+                    if (sec >= 0.5)
+                        rates.push_back((total_generated() - last) / sec);
+                    return;
+                }
+                uint64_t cur = total_generated();
+                rates.push_back((double) (cur - last));
+                last = cur;
+                if (k == warmup_sec) {
+                    discard_latencies();
+                    discard_op_stats();
+                    discard_combiner_counts();
+                }
+            }
+        });
+    }
+
+    // stop sampling (after the sources are over)
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cond.notify_one();
+        if (sampler.joinable())
+            sampler.join();
+    }
+
+    // print the rate of every second and the steady-state throughput (after stop)
+    void report() const
+    {
+        // the seconds after the end of the sources are not part of the run
+        size_t n = rates.size();
+        while (n > 0 && rates[n - 1] == 0)
+            n--;
+        cout << "[Main] Throughput per second";
+        for (size_t i=0; i<n; i++)
+            cout << ((i == warmup_sec && i > 0) ? " |" : "") << " " << rates[i];
+        cout << ((warmup_sec > 0) ? " (warm-up before |)" : "") << endl;
+        if (n <= warmup_sec) {
+            cout << "[Main] Steady-state throughput not measured (run not longer than the warm-up of " << warmup_sec << " sec)" << endl;
+            return;
+        }
+        size_t m = n - warmup_sec;
+        const double *steady = rates.data() + warmup_sec;
+        double mean = 0, stdev = 0, min_rate = steady[0], max_rate = steady[0];
+        for (size_t i=0; i<m; i++) {
+            mean += steady[i] / m;
+            min_rate = (steady[i] < min_rate) ? steady[i] : min_rate;
+            max_rate = (steady[i] > max_rate) ? steady[i] : max_rate;
+        }
+        for (size_t i=0; i<m; i++)
+            stdev += (steady[i] - mean) * (steady[i] - mean);
+        stdev = (m > 1) ? sqrt(stdev / (m - 1)) : 0;
+        cout << "[Main] Steady-state throughput " << mean << " (stdev " << stdev << ", min " << min_rate << ", max " << max_rate
+             << " over " << m << " sec after a warm-up of " << warmup_sec << " sec";
+        if (m >= 3) {
+            double first = 0, last = 0;
+            for (size_t i=0; i<m/3; i++) {
+                first += steady[i];
+                last += steady[m - 1 - i];
+            }
+            cout << ", last third " << showpos << ((first > 0) ? 100.0 * (last - first) / first : 0) << noshowpos << "% from the first";
+        }
+        cout << ")" << endl;
+    }
+};
+
+#endif
@@ -0,0 +1,231 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Tuple layouts of the Yahoo! Streaming Benchmark
+ *
+ *  The padded layouts keep the record sizes of the original benchmark (72
+ *  bytes), while the compact ones store only the fields read by the operators
+ *  in their wire size: 32-bit ad and campaign ids (both are dense indexes) and
+ *  32-bit timestamps, i.e. usec since the start of the run. The timestamps are
+ *  not rebased, so they wrap after COMPACT_TS_LIMIT usec (about 71.6 minutes
+ *  of event time, including the event time a resumed run starts from) and a
+ *  wrapped value may be read as the EOS marker: the drivers reject runs that
+ *  would reach the limit. Both layouts have the same interface, and the one
+ *  used by the operators is selected at compile time (see ysb_common.hpp).
+ */
+
+#ifndef TUPLE_LAYOUTS_H
+#define TUPLE_LAYOUTS_H
+
+// include
+#include <tuple>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+// first timestamp (usec) not representable by the compact layouts (used as the EOS marker)
+const uint64_t COMPACT_TS_LIMIT = UINT32_MAX;
+
+// 32-bit timestamp of the compact layouts (the EOS marker is preserved)
+struct delta_ts_t
+{
+    uint32_t delta; // usec since the start of the run
+
+    // constructor
+    delta_ts_t(): delta(0) {}
+
+    // assignment from a 64-bit timestamp
+    delta_ts_t &operator=(uint64_t ts)
+    {
+        delta = (ts == (uint64_t) -1) ? UINT32_MAX : (uint32_t) ts;
+        return *this;
+    }
+
+    // conversion to a 64-bit timestamp
+    operator uint64_t() const
+    {
+        return (delta == UINT32_MAX) ? (uint64_t) -1 : delta;
+    }
+};
+
+// padded_event_t struct (record size of the original benchmark)
+struct padded_event_t
+{
+    uint64_t ts; // timestamp
+    unsigned long user_id; // user id
+    unsigned long page_id; // page id
+    unsigned long ad_id; // advertisement id
+    unsigned int ad_type; // advertisement type (0, 1, 2, 3, 4) => ("banner", "modal", "sponsored-search", "mail", "mobile")
+    size_t event_type; // event type (0, 1, 2) => ("view", "click", "purchase")
+    unsigned int ip; // ip address
+    char padding[20]; // padding
+
+    // constructor
+    padded_event_t() {}
+
+    // getControlFields method
+    tuple<size_t, uint64_t, uint64_t> getControlFields() const
+    {
+        return tuple<size_t, uint64_t, uint64_t>(event_type, 0, ts);
+    }
+
+    // setControlFields method
+    void setControlFields(size_t _key, uint64_t _id, uint64_t _ts)
+    {
+        event_type = _key;
+        ts = _ts;
+    }
+};
+
+// padded_joined_event_t struct (record size of the original benchmark)
+struct padded_joined_event_t
+{
+    uint64_t ts; // timestamp
+    unsigned long ad_id; // advertisement id
+    unsigned long relational_ad_id;
+    size_t cmp_id; // campaign id
+    uint32_t count; // number of events represented (more than one if combined)
+    char padding[32]; // padding
+
+    // constructor
+    padded_joined_event_t(): count(1) {}
+
+    // getControlFields method
+    tuple<size_t, uint64_t, uint64_t> getControlFields() const
+    {
+        return tuple<size_t, uint64_t, uint64_t>(cmp_id, 0, ts);
+    }
+
+    // setControlFields method
+    void setControlFields(size_t _key, uint64_t _id, uint64_t _ts)
+    {
+        cmp_id = _key;
+        ts = _ts;
+    }
+};
+
+// padded_win_result struct (record size of the original benchmark)
+struct padded_win_result
+{
+    uint64_t wid; // id
+    uint64_t ts; // timestamp
+    size_t cmp_id; // campaign id
+    unsigned long lastUpdate; // MAX(TS)
+    unsigned long count; // COUNT(*)
+    char padding[28]; // padding
+
+    // constructor
+    padded_win_result(): lastUpdate(0), count(0) {}
+
+    // getControlFields method
+    tuple<size_t, uint64_t, uint64_t> getControlFields() const
+    {
+        return tuple<size_t, uint64_t, uint64_t>(cmp_id, wid, ts);
+    }
+
+    // setControlFields method
+    void setControlFields(size_t _key, uint64_t _id, uint64_t _ts)
+    {
+        cmp_id = _key;
+        wid = _id;
+        ts = _ts;
+    }
+};
+
+// compact_event_t struct (user_id, page_id and ip are not stored)
+struct compact_event_t
+{
+    delta_ts_t ts; // timestamp
+    uint32_t ad_id; // advertisement id
+    uint16_t ad_type; // advertisement type (0, 1, 2, 3, 4) => ("banner", "modal", "sponsored-search", "mail", "mobile")
+    uint16_t event_type; // event type (0, 1, 2) => ("view", "click", "purchase")
+
+    // constructor
+    compact_event_t() {}
+
+    // getControlFields method
+    tuple<size_t, uint64_t, uint64_t> getControlFields() const
+    {
+        return tuple<size_t, uint64_t, uint64_t>(event_type, 0, ts);
+    }
+
+    // setControlFields method
+    void setControlFields(size_t _key, uint64_t _id, uint64_t _ts)
+    {
+        event_type = _key;
+        ts = _ts;
+    }
+};
+
+// compact_joined_event_t struct (relational_ad_id is not stored)
+struct compact_joined_event_t
+{
+    delta_ts_t ts; // timestamp
+    uint32_t ad_id; // advertisement id
+    uint32_t cmp_id; // campaign id
+    uint32_t count; // number of events represented (more than one if combined)
+
+    // constructor
+    compact_joined_event_t(): count(1) {}
+
+    // getControlFields method
+    tuple<size_t, uint64_t, uint64_t> getControlFields() const
+    {
+        return tuple<size_t, uint64_t, uint64_t>(cmp_id, 0, ts);
+    }
+
+    // setControlFields method
+    void setControlFields(size_t _key, uint64_t _id, uint64_t _ts)
+    {
+        cmp_id = _key;
+        ts = _ts;
+    }
+};
+
+// compact_win_result struct
+struct compact_win_result
+{
+    uint32_t wid; // id
+    delta_ts_t ts; // timestamp
+    uint32_t cmp_id; // campaign id
+    delta_ts_t lastUpdate; // MAX(TS)
+    uint32_t count; // COUNT(*)
+
+    // constructor
+    compact_win_result(): count(0) {}
+
+    // getControlFields method
+    tuple<size_t, uint64_t, uint64_t> getControlFields() const
+    {
+        return tuple<size_t, uint64_t, uint64_t>(cmp_id, wid, ts);
+    }
+
+    // setControlFields method
+    void setControlFields(size_t _key, uint64_t _id, uint64_t _ts)
+    {
+        cmp_id = _key;
+        wid = _id;
+        ts = _ts;
+    }
+};
+
+static_assert(sizeof(compact_event_t) == 12, "compact_event_t is not 12 bytes");
+static_assert(sizeof(compact_joined_event_t) == 16, "compact_joined_event_t is not 16 bytes");
+static_assert(sizeof(compact_win_result) == 20, "compact_win_result is not 20 bytes");
+
+#endif
@@ -0,0 +1,113 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Window semantics of the Yahoo! Streaming Benchmark
+ *
+ *  - tumbling:[size]: consecutive windows of size msec (10 sec by default);
+ *  - sliding:[size]:[slide]: windows of size msec starting every slide msec.
+ *    The events update panes of gcd(size, slide) msec, and each window merges
+ *    its panes when fired, so an event is aggregated once however many
+ *    windows contain it;
+ *  - session:[gap]: the events of a campaign are in the same window until
+ *    they are separated by more than gap msec.
+ */
+
+#ifndef WINDOW_SPEC_H
+#define WINDOW_SPEC_H
+
+// include
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+
+using namespace std;
+
+// Kind and parameters of the windows (all the times are in usec)
+struct WindowSpec
+{
+    enum kind_t { TUMBLING, SLIDING, SESSION };
+
+    kind_t kind;
+    uint64_t size; // length of the windows (tumbling and sliding)
+    uint64_t slide; // distance between the starts of two windows (sliding)
+    uint64_t gap; // maximum distance of two events in the same window (session)
+
+    // constructor (tumbling windows of 10 sec)
+    WindowSpec(): kind(TUMBLING), size(10000000), slide(10000000), gap(0) {}
+
+    // get the length of the panes updated by the events (tumbling and sliding)
+    uint64_t pane() const
+    {
+        uint64_t a = size, b = slide;
+        while (b != 0) {
+            uint64_t t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    // get the end of the window with a given id (tumbling and sliding)
+    uint64_t window_end(uint64_t wid) const
+    {
+        return wid * slide + size;
+    }
+};
+
+// parse the windows "tumbling:[size]", "sliding:[size]:[slide]" or "session:[gap]" in msec (returns false if not valid)
+static inline bool parse_window_spec(const string &text, WindowSpec &spec)
+{
+    spec = WindowSpec();
+    stringstream ss(text);
+    string kind, p1, p2;
+    getline(ss, kind, ':');
+    getline(ss, p1, ':');
+    getline(ss, p2, ':');
+    uint64_t v1 = strtoull(p1.c_str(), nullptr, 10) * 1000;
+    uint64_t v2 = strtoull(p2.c_str(), nullptr, 10) * 1000;
+    if (kind == "tumbling") {
+        spec.size = spec.slide = v1;
+        return v1 > 0 && p2.empty();
+    }
+    else if (kind == "sliding") {
+        spec.kind = WindowSpec::SLIDING;
+        spec.size = v1;
+        spec.slide = v2;
+        return v2 > 0 && v2 <= v1;
+    }
+    else if (kind == "session") {
+        spec.kind = WindowSpec::SESSION;
+        spec.gap = v1;
+        return v1 > 0 && p2.empty();
+    }
+    return false;
+}
+
+// get the description of the windows
+static inline string window_spec_name(const WindowSpec &spec)
+{
+    stringstream ss;
+    switch (spec.kind) {
+        case WindowSpec::SLIDING: ss << "sliding:" << spec.size / 1000 << ":" << spec.slide / 1000; break;
+        case WindowSpec::SESSION: ss << "session:" << spec.gap / 1000; break;
+        default: ss << "tumbling:" << spec.size / 1000;
+    }
+    return ss.str();
+}
+
+#endif
@@ -0,0 +1,211 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Keyed state store of the window operators
+ *
+ *  Open-addressing table with linear probing whose slots keep the key and the
+ *  state inline. Slots are aligned to the cache line, so a lookup that hits
+ *  its home slot touches a single line, and the next lookups of a batch can
+ *  be prefetched. The table doubles when it becomes half full.
+ */
+
+#ifndef WINDOW_STORE_H
+#define WINDOW_STORE_H
+
+// include
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#include <utility>
+
+using namespace std;
+
+// Open-addressing table from unsigned long keys to states of type V
+template<typename V>
+class FlatStateStore
+{
+private:
+    static const unsigned long EMPTY = (unsigned long) -1; // key of the empty slots
+
+    // slot of the table (key and state in the same cache line)
+    struct alignas(64) slot_t
+    {
+        unsigned long key;
+        V value;
+    };
+
+    slot_t *slots;
+    size_t capacity; // power of two
+    unsigned int shift;
+    size_t count;
+
+    // home position of a key (Fibonacci hashing)
+    inline size_t home(unsigned long key) const
+    {
+        return (key * 11400714819323198485ull) >> shift;
+    }
+
+    // allocate an empty table
+    void allocate(size_t _capacity)
+    {
+        capacity = _capacity;
+        shift = 64;
+        for (size_t c=capacity; c>1; c>>=1)
+            shift--;
+        void *mem = nullptr;
+        if (posix_memalign(&mem, 64, sizeof(slot_t) * capacity) != 0)
+            throw std::bad_alloc();
+        slots = (slot_t *) mem;
+        for (size_t i=0; i<capacity; i++) {
+            slots[i].key = EMPTY;
+            new (&slots[i].value) V();
+        }
+        count = 0;
+    }
+
+    // release the table
+    void release()
+    {
+        for (size_t i=0; i<capacity; i++)
+            slots[i].value.~V();
+        free(slots);
+        slots = nullptr;
+    }
+
+    // double the capacity of the table
+    void grow()
+    {
+        slot_t *old_slots = slots;
+        size_t old_capacity = capacity;
+        allocate(2 * capacity);
+        for (size_t i=0; i<old_capacity; i++) {
+            if (old_slots[i].key != EMPTY) {
+                bool inserted;
+                get(old_slots[i].key, inserted) = old_slots[i].value;
+            }
+            old_slots[i].value.~V();
+        }
+        free(old_slots);
+    }
+
+public:
+    // constructor
+    FlatStateStore(size_t _capacity=16): slots(nullptr)
+    {
+        size_t c = 2;
+        while (c < _capacity)
+            c <<= 1;
+        allocate(c);
+    }
+
+    // copy constructor
+    FlatStateStore(const FlatStateStore &other): slots(nullptr)
+    {
+        allocate(other.capacity);
+        for (size_t i=0; i<capacity; i++) {
+            slots[i].key = other.slots[i].key;
+            slots[i].value = other.slots[i].value;
+        }
+        count = other.count;
+    }
+
+    // copy assignment
+    FlatStateStore &operator=(FlatStateStore other)
+    {
+        std::swap(slots, other.slots);
+        std::swap(capacity, other.capacity);
+        std::swap(shift, other.shift);
+        std::swap(count, other.count);
+        return *this;
+    }
+
+    // destructor
+    ~FlatStateStore()
+    {
+        if (slots != nullptr)
+            release();
+    }
+
+    // get the state of a key, inserting a default one if it is not present
+    inline V &get(unsigned long key, bool &inserted)
+    {
+        size_t pos = home(key);
+        while (slots[pos].key != EMPTY) {
+            if (slots[pos].key == key) {
+                inserted = false;
+                return slots[pos].value;
+            }
+            pos = (pos + 1) & (capacity - 1);
+        }
+        if (2 * (count + 1) > capacity) {
+            grow();
+            return get(key, inserted);
+        }
+        slots[pos].key = key;
+        count++;
+        inserted = true;
+        return slots[pos].value;
+    }
+
+    // get the state of a key (nullptr if it is not present)
+    inline V *find(unsigned long key)
+    {
+        size_t pos = home(key);
+        while (slots[pos].key != EMPTY) {
+            if (slots[pos].key == key)
+                return &slots[pos].value;
+            pos = (pos + 1) & (capacity - 1);
+        }
+        return nullptr;
+    }
+
+    // prefetch the home slot of a key (for writing)
+    inline void prefetch(unsigned long key) const
+    {
+        __builtin_prefetch(&slots[home(key)], 1);
+    }
+
+    // call f(key, state) for all the keys in the table
+    template<typename F>
+    void for_each(F f)
+    {
+        for (size_t i=0; i<capacity; i++) {
+            if (slots[i].key != EMPTY)
+                f(slots[i].key, slots[i].value);
+        }
+    }
+
+    // remove all the keys (the capacity is kept)
+    void clear()
+    {
+        for (size_t i=0; i<capacity && count>0; i++) {
+            if (slots[i].key != EMPTY) {
+                slots[i].key = EMPTY;
+                slots[i].value = V();
+                count--;
+            }
+        }
+    }
+
+    // get the number of keys
+    size_t size() const
+    {
+        return count;
+    }
+};
+
+#endif
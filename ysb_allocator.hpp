@@ -0,0 +1,207 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Allocator of the tuples of the Yahoo! Streaming Benchmark
+ *
+ *  Tuples are created by one TBB worker and usually destroyed by another one.
+ *  The pool below keeps a cache of fixed-size blocks per thread: blocks freed
+ *  by the owner thread go back to a private free list, while blocks freed by
+ *  other threads are pushed onto a lock-free stack of the owner cache, which
+ *  reclaims it as a whole when its private list runs empty.
+ *
+ *  Batches are recycled by a pool of the same kind that keeps the objects
+ *  constructed, so a batch taken from the pool still owns the column buffers
+ *  of its previous use and moves through the graph without heap allocations.
+ */
+
+#ifndef YSB_ALLOCATOR_H
+#define YSB_ALLOCATOR_H
+
+// include
+#include <new>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <type_traits>
+
+using namespace std;
+
+// global variable: true if tuples are allocated from the per-thread pools
+bool use_pool_allocator = false;
+
+// global variable: true if batches are recycled by the per-thread pools
+bool recycle_batches = true;
+
+// global variable: number of slabs allocated by all the pools
+std::atomic<long> poolSlabs;
+
+// Per-thread slab allocator of objects of type T (objects are kept constructed
+// when freed and reused as they are if Recycle is true)
+template<typename T, bool Recycle=false>
+class ObjectPool
+{
+private:
+    struct Cache;
+
+    // block containing one object and the pointer to its owner cache
+    struct Block
+    {
+        Cache *owner;
+        Block *next;
+        bool live; // true if the storage contains a constructed object (if Recycle)
+        typename aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    // per-thread cache (remote_free in its own cache line)
+    struct Cache
+    {
+        Block *local_free; // accessed by the owner thread only
+        alignas(64) std::atomic<Block *> remote_free; // pushed by the other threads
+
+        // constructor
+        Cache(): local_free(nullptr), remote_free(nullptr) {}
+    };
+
+    static const size_t SLAB_BLOCKS = 4096; // blocks carved from each slab
+
+    // get the cache of the calling thread (caches are never released because
+    // their blocks may still be in flight when a TBB worker exits)
+    static Cache *myCache()
+    {
+        static thread_local Cache *cache = nullptr;
+        if (cache == nullptr) {
+            void *mem = nullptr;
+            if (posix_memalign(&mem, 64, sizeof(Cache)) != 0) abort();
+            cache = new (mem) Cache();
+        }
+        return cache;
+    }
+
+    // carve a new slab into a list of free blocks owned by the cache
+    static Block *refill(Cache *cache)
+    {
+        Block *slab = (Block *) malloc(sizeof(Block) * SLAB_BLOCKS);
+        if (slab == nullptr) abort();
+        for (size_t i=0; i<SLAB_BLOCKS; i++) {
+            slab[i].owner = cache;
+            slab[i].live = false;
+            slab[i].next = (i+1 < SLAB_BLOCKS) ? &slab[i+1] : nullptr;
+        }
+        poolSlabs.fetch_add(1);
+        return slab;
+    }
+
+public:
+    // allocate and default-construct an object (or reuse a freed one if Recycle)
+    static T *allocate()
+    {
+        Cache *cache = myCache();
+        Block *b = cache->local_free;
+        if (b == nullptr) {
+            // take back all the blocks freed remotely in one shot (no ABA since
+            // the stack is never popped one element at a time)
+            b = cache->remote_free.exchange(nullptr, std::memory_order_acquire);
+            if (b == nullptr)
+                b = refill(cache);
+        }
+        cache->local_free = b->next;
+        if (Recycle && b->live)
+            return (T *) &b->storage;
+        b->live = true;
+        return new (&b->storage) T();
+    }
+
+    // destroy an object (unless Recycle) and give its block back to the owner cache
+    static void deallocate(T *obj)
+    {
+        if (!Recycle)
+            obj->~T();
+        Block *b = (Block *) (((char *) obj) - offsetof(Block, storage));
+        Cache *cache = b->owner;
+        if (cache == myCache()) {
+            b->next = cache->local_free;
+            cache->local_free = b;
+        }
+        else {
+            Block *head = cache->remote_free.load(std::memory_order_relaxed);
+            do {
+                b->next = head;
+            } while (!cache->remote_free.compare_exchange_weak(head, b, std::memory_order_release, std::memory_order_relaxed));
+        }
+    }
+};
+
+/**
+ *  \brief Function to allocate a tuple
+ *
+ *  This function allocates a tuple of type T either from the per-thread pools
+ *  or with the global operator new, depending on use_pool_allocator.
+ */
+template<typename T>
+static inline T *alloc_tuple()
+{
+    if (use_pool_allocator)
+        return ObjectPool<T>::allocate();
+    return new T();
+}
+
+/**
+ *  \brief Function to free a tuple
+ *
+ *  This function frees a tuple allocated by alloc_tuple(). It can be called by
+ *  any thread, not only by the one which allocated the tuple.
+ */
+template<typename T>
+static inline void free_tuple(T *ptr)
+{
+    if (use_pool_allocator)
+        ObjectPool<T>::deallocate(ptr);
+    else
+        delete ptr;
+}
+
+/**
+ *  \brief Function to allocate a batch
+ *
+ *  This function allocates a batch of type T either from the per-thread pools,
+ *  which return a previously used batch with its buffers, or with the global
+ *  operator new, depending on recycle_batches. The caller must reset the batch.
+ */
+template<typename T>
+static inline T *alloc_batch()
+{
+    if (recycle_batches)
+        return ObjectPool<T, true>::allocate();
+    return new T();
+}
+
+/**
+ *  \brief Function to free a batch
+ *
+ *  This function frees a batch allocated by alloc_batch(). It can be called by
+ *  any thread, not only by the one which allocated the batch.
+ */
+template<typename T>
+static inline void free_batch(T *ptr)
+{
+    if (recycle_batches)
+        ObjectPool<T, true>::deallocate(ptr);
+    else
+        delete ptr;
+}
+
+#endif
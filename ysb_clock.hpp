@@ -0,0 +1,269 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Timestamp service of the Yahoo! Streaming Benchmark
+ *
+ *  The operators read the time with now_usecs(), which returns microseconds
+ *  from the epoch like current_time_usecs() but can be cheaper depending on
+ *  the clock mode:
+ *  - syscall: clock_gettime() at every call (default);
+ *  - tsc: time stamp counter scaled with a factor calibrated at start-up;
+ *  - batch: clock_gettime() once every CLOCK_BATCH_CALLS calls of a thread,
+ *    or earlier if CLOCK_BATCH_MAX_US usec passed since the last one (checked
+ *    with the time stamp counter, so a thread calling it rarely does not keep
+ *    a stale value);
+ *  - coarse: value published every CLOCK_COARSE_US usec by a background thread.
+ *  The values returned to a thread never go backwards.
+ */
+
+#ifndef YSB_CLOCK_H
+#define YSB_CLOCK_H
+
+// include
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <sys/time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define YSB_HAS_TSC
+#endif
+
+using namespace std;
+
+/**
+ *  \brief Function to return the number of microseconds from the epoch
+ *
+ *  This function returns the number of microseconds from the epoch using
+ *  the clock_gettime() call.
+ */
+static inline unsigned long current_time_usecs() __attribute__((always_inline));
+static inline unsigned long current_time_usecs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return (t.tv_sec)*1000000L + (t.tv_nsec / 1000);
+}
+
+// modes of the timestamp service
+enum clock_mode_t { CLOCK_MODE_SYSCALL, CLOCK_MODE_TSC, CLOCK_MODE_BATCH, CLOCK_MODE_COARSE };
+
+// calls of a thread sharing the same clock_gettime() in batch mode
+const unsigned int CLOCK_BATCH_CALLS = 64;
+
+// maximum age of the value shared by the calls in batch mode
+const unsigned int CLOCK_BATCH_MAX_US = 10;
+
+// period of the background thread in coarse mode
+const unsigned int CLOCK_COARSE_US = 50;
+
+// global variable: mode of the timestamp service
+clock_mode_t clockMode = CLOCK_MODE_SYSCALL;
+
+// global variable: calibration of the tsc mode
+uint64_t clockTscBase;
+unsigned long clockUsecBase;
+double clockUsecPerTick;
+
+// global variable: ticks of the time stamp counter in CLOCK_BATCH_MAX_US usec (batch mode)
+uint64_t clockBatchMaxTicks;
+
+// global variable: time published by the background thread in coarse mode
+std::atomic<unsigned long> clockCoarseUsec;
+std::atomic<bool> clockCoarseRunning;
+std::thread clockCoarseThread;
+
+// global variable: per-thread number of calls of now_usecs()
+vector<uint64_t *> clockCalls;
+std::mutex clockCallsMutex;
+
+// per-thread state of the timestamp service
+struct clock_thread_state
+{
+    unsigned long last; // last value returned to the thread
+    unsigned int batch_left; // calls left before the next clock_gettime() (batch mode)
+    uint64_t batch_tsc; // time stamp counter at the last clock_gettime() (batch mode)
+    uint64_t *calls; // number of calls of the thread
+
+    // constructor
+    clock_thread_state(): last(0), batch_left(0), batch_tsc(0)
+    {
+        calls = new uint64_t(0);
+        std::lock_guard<std::mutex> lock(clockCallsMutex);
+        clockCalls.push_back(calls);
+    }
+};
+
+/**
+ *  \brief Function to return the number of microseconds from the epoch
+ *
+ *  This function returns the number of microseconds from the epoch using
+ *  the timestamp service in the mode selected with clock_init().
+ */
+static inline unsigned long now_usecs()
+{
+    static thread_local clock_thread_state state;
+    unsigned long t;
+    (*state.calls)++;
+    switch (clockMode) {
+#if defined(YSB_HAS_TSC)
+        case CLOCK_MODE_TSC:
+            t = clockUsecBase + (unsigned long) ((__rdtsc() - clockTscBase) * clockUsecPerTick);
+            break;
+        case CLOCK_MODE_BATCH: {
+            uint64_t tsc = __rdtsc();
+            if (state.batch_left > 0 && tsc - state.batch_tsc < clockBatchMaxTicks) {
+                state.batch_left--;
+                return state.last;
+            }
+            state.batch_left = CLOCK_BATCH_CALLS - 1;
+            state.batch_tsc = tsc;
+            t = current_time_usecs();
+            break;
+        }
+#endif
+        case CLOCK_MODE_COARSE:
+            t = clockCoarseUsec.load(std::memory_order_relaxed);
+            break;
+        default:
+            t = current_time_usecs();
+    }
+    state.last = (t > state.last) ? t : state.last;
+    return state.last;
+}
+
+// check whether the CPU has an invariant time stamp counter
+static inline bool clock_tsc_invariant()
+{
+#if defined(YSB_HAS_TSC)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0)
+        return false;
+    return (edx & (1u << 8)) != 0;
+#else
+    return false;
+#endif
+}
+
+/**
+ *  \brief Function to start the timestamp service
+ *
+ *  This function calibrates the time stamp counter (tsc and batch modes) or
+ *  starts the background thread (coarse mode). It returns false if the mode
+ *  cannot be used on this machine.
+ */
+static inline bool clock_init(clock_mode_t mode)
+{
+    if (mode == CLOCK_MODE_TSC || mode == CLOCK_MODE_BATCH) {
+#if defined(YSB_HAS_TSC)
+        if (mode == CLOCK_MODE_TSC && !clock_tsc_invariant())
+            return false; // the batch mode only bounds the age of its values
+        uint64_t tsc0 = __rdtsc();
+        unsigned long usec0 = current_time_usecs();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        uint64_t tsc1 = __rdtsc();
+        unsigned long usec1 = current_time_usecs();
+        clockUsecPerTick = ((double) (usec1 - usec0)) / (tsc1 - tsc0);
+        clockTscBase = tsc1;
+        clockUsecBase = usec1;
+        clockBatchMaxTicks = (uint64_t) (CLOCK_BATCH_MAX_US / clockUsecPerTick);
+#else
+        return false;
+#endif
+    }
+    else if (mode == CLOCK_MODE_COARSE) {
+        clockCoarseUsec = current_time_usecs();
+        clockCoarseRunning = true;
+        clockCoarseThread = std::thread([] () {
+            while (clockCoarseRunning.load()) {
+                clockCoarseUsec.store(current_time_usecs(), std::memory_order_relaxed);
+                std::this_thread::sleep_for(std::chrono::microseconds(CLOCK_COARSE_US));
+            }
+        });
+    }
+    clockMode = mode;
+    return true;
+}
+
+// stop the timestamp service
+static inline void clock_shutdown()
+{
+    if (clockMode == CLOCK_MODE_COARSE) {
+        clockCoarseRunning = false;
+        clockCoarseThread.join();
+    }
+}
+
+// get the name of a clock mode
+static inline const char *clock_mode_name(clock_mode_t mode)
+{
+    switch (mode) {
+        case CLOCK_MODE_SYSCALL: return "syscall";
+        case CLOCK_MODE_TSC: return "tsc";
+        case CLOCK_MODE_BATCH: return "batch";
+        case CLOCK_MODE_COARSE: return "coarse";
+    }
+    return "unknown";
+}
+
+// parse the name of a clock mode (returns false if unknown)
+static inline bool parse_clock_mode(const string &name, clock_mode_t &mode)
+{
+    if (name == "syscall") mode = CLOCK_MODE_SYSCALL;
+    else if (name == "tsc") mode = CLOCK_MODE_TSC;
+    else if (name == "batch") mode = CLOCK_MODE_BATCH;
+    else if (name == "coarse") mode = CLOCK_MODE_COARSE;
+    else return false;
+    return true;
+}
+
+// get the cost (nsec per call) of now_usecs() in the current mode, or of clock_gettime() if syscall is true
+static inline double clock_cost_ns(size_t samples, bool syscall)
+{
+    volatile unsigned long sink = 0;
+    unsigned long start = current_time_usecs();
+    if (syscall) {
+        for (size_t i=0; i<samples; i++)
+            sink += current_time_usecs();
+    }
+    else {
+        for (size_t i=0; i<samples; i++)
+            sink += now_usecs();
+    }
+    return (current_time_usecs() - start) * 1000.0 / samples;
+}
+
+// print the clock mode and the calls done by the operators during the run
+// (the cost of the modes is measured by bench_clock)
+static inline void clock_report()
+{
+    uint64_t calls = 0;
+    {
+        std::lock_guard<std::mutex> lock(clockCallsMutex);
+        for (auto c: clockCalls)
+            calls += *c;
+    }
+    cout << "[Main] Clock " << clock_mode_name(clockMode) << ", " << calls << " calls" << endl;
+}
+
+#endif
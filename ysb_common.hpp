@@ -27,114 +27,221 @@
 
 // include
 #include <tuple>
+#include <vector>
 #include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <alloc_counter.hpp>
+#include <tuple_layouts.hpp>
 #include "tbb/flow_graph.h"
 
 using namespace std;
 using namespace tbb::flow;
 
-// event_t struct
-struct event_t
-{
-    uint64_t ts; // timestamp
-    unsigned long user_id; // user id
-    unsigned long page_id; // page id
-    unsigned long ad_id; // advertisement id
-    unsigned int ad_type; // advertisement type (0, 1, 2, 3, 4) => ("banner", "modal", "sponsored-search", "mail", "mobile")
-    size_t event_type; // event type (0, 1, 2) => ("view", "click", "purchase")
-    unsigned int ip; // ip address
-    char padding[20]; // padding
+// tuple layouts used by the operators: padded as in the original benchmark, or
+// compact if compiled with -DYSB_COMPACT_TUPLES (also narrowing the id columns
+// of the batches)
+#if defined(YSB_COMPACT_TUPLES)
+typedef compact_event_t event_t;
+typedef compact_joined_event_t joined_event_t;
+typedef compact_win_result win_result;
+typedef uint32_t ysb_id_t;
+#else
+typedef padded_event_t event_t;
+typedef padded_joined_event_t joined_event_t;
+typedef padded_win_result win_result;
+typedef unsigned long ysb_id_t;
+#endif
 
-    // constructor
-    event_t() {}
+// struct implementing a window
+struct Window {
+    unsigned long count;
+    uint64_t initial_ts;
+    uint64_t last_ts;
+    uint64_t last_Update;
 
-    // getControlFields method
-    tuple<size_t, uint64_t, uint64_t> getControlFields() const
-    {
-        return tuple<size_t, uint64_t, uint64_t>(event_type, 0, ts);
-    }
+    // default constructor
+    Window(): count(0), initial_ts((uint64_t) -1), last_ts(0), last_Update(0) {}
 
-    // setControlFields method
-    void setControlFields(size_t _key, uint64_t _id, uint64_t _ts)
-    {
-        event_type = _key;
-        ts = _ts;
+    // constructor
+    Window(long _count, long _initial_ts, long _last_ts):
+	       count(_count), initial_ts(_initial_ts), last_ts(_last_ts) {}
+
+    // set method
+    void set(long _count, long _initial_ts, long _last_ts) {
+    	count = _count;
+    	initial_ts = _initial_ts;
+    	last_ts = _last_ts;
     }
 };
 
-// joined_event_t struct
-struct joined_event_t
+// round the size of a column up to a multiple of the cache line size
+static inline size_t column_bytes(size_t n, size_t elem_size)
+{
+    return ((n * elem_size + 63) / 64) * 64;
+}
+
+// event_batch_t struct (columnar batch of events). Only the fields used by the
+// queries are materialized, all the columns are stored in one aligned buffer
+struct event_batch_t
 {
-    uint64_t ts; // timestamp
-    unsigned long ad_id; // advertisement id
-    unsigned long relational_ad_id;
-    size_t cmp_id; // campaign id
-    char padding[36]; // padding
+    uint64_t *ts; // column of timestamps
+    ysb_id_t *ad_id; // column of advertisement ids
+    uint32_t *event_type; // column of event types
+    uint32_t *sel; // selection vector (positions of the events passing the filter)
+    size_t size; // number of events
+    size_t sel_size; // number of entries in the selection vector
+    size_t capacity; // maximum number of events
+    uint64_t watermark; // no later event of the same source has a smaller timestamp
+    uint64_t checkpoint; // id of the checkpoint whose barrier follows the batch (0 if none)
+    bool eos; // true in the last batch produced by a source
+    char *storage; // buffer of the columns
 
     // constructor
-    joined_event_t() {}
+    event_batch_t(): ts(nullptr), ad_id(nullptr), event_type(nullptr), sel(nullptr),
+                     size(0), sel_size(0), capacity(0), watermark(0), checkpoint(0), eos(false), storage(nullptr) {}
+
+    // batches are moved by pointer only
+    event_batch_t(const event_batch_t &) = delete;
+    event_batch_t &operator=(const event_batch_t &) = delete;
+
+    // destructor
+    ~event_batch_t()
+    {
+        free(storage);
+    }
 
-    // getControlFields method
-    tuple<size_t, uint64_t, uint64_t> getControlFields() const
+    // empty the batch making room for _capacity events (the columns are set
+    // back to the buffer, since a replayed batch points them into the log)
+    void reset(size_t _capacity)
     {
-        return tuple<size_t, uint64_t, uint64_t>(cmp_id, 0, ts);
+        size = 0;
+        sel_size = 0;
+        watermark = 0;
+        checkpoint = 0;
+        eos = false;
+        size_t ts_bytes = column_bytes(std::max(_capacity, capacity), sizeof(uint64_t));
+        size_t ad_bytes = column_bytes(std::max(_capacity, capacity), sizeof(ysb_id_t));
+        size_t type_bytes = column_bytes(std::max(_capacity, capacity), sizeof(uint32_t));
+        if (_capacity > capacity) {
+            free(storage);
+            size_t sel_bytes = column_bytes(_capacity, sizeof(uint32_t));
+            AllocCounter::add();
+            if (posix_memalign((void **) &storage, 64, ts_bytes + ad_bytes + type_bytes + sel_bytes) != 0) abort();
+            capacity = _capacity;
+        }
+        ts = (uint64_t *) storage;
+        ad_id = (ysb_id_t *) (storage + ts_bytes);
+        event_type = (uint32_t *) (storage + ts_bytes + ad_bytes);
+        sel = (uint32_t *) (storage + ts_bytes + ad_bytes + type_bytes);
     }
 
-    // setControlFields method
-    void setControlFields(size_t _key, uint64_t _id, uint64_t _ts)
+    // append an event
+    void push_back(uint64_t _ts, unsigned long _ad_id, uint32_t _event_type)
     {
-        cmp_id = _key;
-        ts = _ts;
+        ts[size] = _ts;
+        ad_id[size] = _ad_id;
+        event_type[size] = _event_type;
+        size++;
     }
 };
 
-// win_result struct
-struct win_result
+// joined_batch_t struct (columnar batch of joined events)
+struct joined_batch_t
 {
-    uint64_t wid; // id
-    uint64_t ts; // timestamp
-    size_t cmp_id; // campaign id
-    unsigned long lastUpdate; // MAX(TS)
-    unsigned long count; // COUNT(*)
-    char padding[28]; // padding
+    uint64_t *ts; // column of timestamps
+    ysb_id_t *ad_id; // column of advertisement ids
+    ysb_id_t *cmp_id; // column of campaign ids
+    uint32_t *count; // column of the events represented by each entry (read only if combined)
+    size_t size; // number of joined events
+    size_t capacity; // maximum number of joined events
+    size_t src_id; // identifier of the join which produced the batch
+    uint64_t watermark; // no later event from the same join has a smaller timestamp
+    uint64_t checkpoint; // id of the checkpoint whose barrier follows the batch (0 if none)
+    bool eos; // true if the sender has no more batches
+    bool combined; // true if the entries are partials of the combiner (ts is their last timestamp)
+    char *storage; // buffer of the columns
 
     // constructor
-    win_result(): lastUpdate(0), count(0) {}
+    joined_batch_t(): ts(nullptr), ad_id(nullptr), cmp_id(nullptr), count(nullptr), size(0), capacity(0),
+                      src_id(0), watermark(0), checkpoint(0), eos(false), combined(false), storage(nullptr) {}
 
-    // getControlFields method
-    tuple<size_t, uint64_t, uint64_t> getControlFields() const
+    // batches are moved by pointer only
+    joined_batch_t(const joined_batch_t &) = delete;
+    joined_batch_t &operator=(const joined_batch_t &) = delete;
+
+    // destructor
+    ~joined_batch_t()
     {
-        return tuple<size_t, uint64_t, uint64_t>(cmp_id, wid, ts);
+        free(storage);
     }
 
-    // setControlFields method
-    void setControlFields(size_t _key, uint64_t _id, uint64_t _ts)
+    // empty the batch making room for _capacity joined events
+    void reset(size_t _capacity)
     {
-        cmp_id = _key;
-        wid = _id;
-        ts = _ts;
+        size = 0;
+        src_id = 0;
+        watermark = 0;
+        checkpoint = 0;
+        eos = false;
+        combined = false;
+        if (_capacity <= capacity)
+            return;
+        free(storage);
+        size_t ts_bytes = column_bytes(_capacity, sizeof(uint64_t));
+        size_t ad_bytes = column_bytes(_capacity, sizeof(ysb_id_t));
+        size_t cmp_bytes = column_bytes(_capacity, sizeof(ysb_id_t));
+        size_t count_bytes = column_bytes(_capacity, sizeof(uint32_t));
+        AllocCounter::add();
+        if (posix_memalign((void **) &storage, 64, ts_bytes + ad_bytes + cmp_bytes + count_bytes) != 0) abort();
+        ts = (uint64_t *) storage;
+        ad_id = (ysb_id_t *) (storage + ts_bytes);
+        cmp_id = (ysb_id_t *) (storage + ts_bytes + ad_bytes);
+        count = (uint32_t *) (storage + ts_bytes + ad_bytes + cmp_bytes);
+        capacity = _capacity;
     }
-};
 
-// struct implementing a window
-struct Window {
-    unsigned long count;
-    uint64_t initial_ts;
-    uint64_t last_ts;
-    uint64_t last_Update;
+    // append a joined event
+    void push_back(uint64_t _ts, unsigned long _ad_id, size_t _cmp_id)
+    {
+        ts[size] = _ts;
+        ad_id[size] = _ad_id;
+        cmp_id[size] = _cmp_id;
+        size++;
+    }
 
-    // default constructor
-    Window(): count(0), initial_ts((uint64_t) -1), last_ts(0), last_Update(0) {}
+    // append a partial of the combiner (the batch becomes combined)
+    void push_back_partial(uint64_t _last_ts, size_t _cmp_id, uint32_t _count)
+    {
+        ts[size] = _last_ts;
+        ad_id[size] = 0;
+        cmp_id[size] = _cmp_id;
+        count[size] = _count;
+        combined = true;
+        size++;
+    }
+};
+
+// win_results_t struct (windows fired by a window worker up to its watermark,
+// partial if the keys are split among the workers)
+struct win_results_t
+{
+    size_t worker; // identifier of the window worker
+    uint64_t watermark; // all the windows ending not later than it have been fired
+    bool eos; // true if the worker has no more results
+    vector<win_result> results;
 
     // constructor
-    Window(long _count, long _initial_ts, long _last_ts):
-	       count(_count), initial_ts(_initial_ts), last_ts(_last_ts) {}
+    win_results_t(): worker(0), watermark(0), eos(false) {}
 
-    // set method
-    void set(long _count, long _initial_ts, long _last_ts) {
-    	count = _count;
-    	initial_ts = _initial_ts;
-    	last_ts = _last_ts;
+    // empty the results keeping their buffer
+    void reset()
+    {
+        worker = 0;
+        watermark = 0;
+        eos = false;
+        results.clear();
     }
 };
 
@@ -144,11 +251,14 @@ typedef multifunction_node<event_t *, tbb::flow::tuple<event_t *>, lightweight>
 typedef function_node<event_t *, continue_msg, lightweight> map_node_t;
 typedef multifunction_node<joined_event_t *, tbb::flow::tuple<win_result *>, lightweight> window_node_t;
 typedef function_node<win_result *, continue_msg, lightweight> sink_node_t;
+typedef source_node<continue_msg> lane_node_t; // fused source, filter and join
+typedef function_node<continue_msg, continue_msg, lightweight> lane_end_node_t; // pulls the activations of a fused lane
 
 // some aliases (batched version)
-typedef source_node<vector<event_t *>> source_node_batched_t;
-typedef multifunction_node<vector<event_t *>, tbb::flow::tuple<vector<event_t *>>> filter_node_batched_t;
-typedef function_node<vector<event_t *>, continue_msg> map_node_batched_t;
-typedef multifunction_node<vector<joined_event_t *>, tbb::flow::tuple<vector<win_result *>>> window_node_batched_t;
+typedef source_node<event_batch_t *> source_node_batched_t;
+typedef multifunction_node<event_batch_t *, tbb::flow::tuple<event_batch_t *>> filter_node_batched_t;
+typedef function_node<event_batch_t *, continue_msg> map_node_batched_t;
+typedef multifunction_node<joined_batch_t *, tbb::flow::tuple<win_results_t *>> window_node_batched_t;
+typedef function_node<win_results_t *, continue_msg> merge_node_batched_t;
 
 #endif
@@ -0,0 +1,473 @@
+/******************************************************************************
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ ******************************************************************************
+ */
+
+/*
+ *  Harness of the Yahoo! Streaming Benchmark
+ *
+ *  The harness runs one of the two versions of the benchmark over the cartesian
+ *  product of the given parallelism degrees, thread counts, batch lengths,
+ *  campaign counts and modes (extra arguments of the runs). Each configuration
+ *  is run a number of times after some warm-up runs, which are discarded, and
+ *  the [Main] lines printed by the runs are parsed (including the steady-state
+ *  throughput, measured after the warm-up of each run if a mode passes -W).
+ *  The CPU time and the peak RSS of each run are taken from the kernel when
+ *  the run exits. The report has one record per configuration (mean and
+ *  spread of the throughput, median of the latency percentiles, CPU
+ *  utilization and peak RSS) in CSV or JSON, and the progress of the sweep is
+ *  printed on stderr. With -k the results of each configuration are first
+ *  written by the binary and by another one (e.g., the other version) and
+ *  their (wid, cmp_id) keys are compared over the windows completed by both
+ *  runs (tumbling windows, since their ids do not depend on the start of the
+ *  run); the sweep stops if they differ.
+ */
+
+// include
+#include <cmath>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+using namespace std;
+
+// get the number of microseconds from the epoch
+static inline unsigned long current_time_usecs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return (t.tv_sec)*1000000L + (t.tv_nsec / 1000);
+}
+
+// configuration of the runs (empty values are not passed to the benchmark)
+struct config_t
+{
+    string pardegree1;
+    string pardegree2;
+    string threads;
+    string batch_len;
+    string campaigns;
+    string mode; // extra arguments
+};
+
+// metrics of a run
+struct run_t
+{
+    bool ok; // true if the run exited normally printing its throughput
+    double throughput; // events/sec
+    double steady_throughput; // events/sec after the warm-up of the run (zero if not measured)
+    double elapsed_sec;
+    double cpu_sec; // user and system time
+    long peak_rss_kb;
+    unsigned long generated;
+    unsigned long results;
+    double tuple_lat[3]; // p50, p99 and p99.9 (usec)
+    double result_lat[3];
+
+    // constructor
+    run_t(): ok(false), throughput(0), steady_throughput(0), elapsed_sec(0), cpu_sec(0), peak_rss_kb(0), generated(0), results(0),
+             tuple_lat{0, 0, 0}, result_lat{0, 0, 0} {}
+};
+
+// split a list separated by commas (or by spaces if sep is ' ')
+static vector<string> split(const string &s, char sep)
+{
+    vector<string> items;
+    string item;
+    istringstream in(s);
+    while (getline(in, item, sep)) {
+        if (!item.empty())
+            items.push_back(item);
+    }
+    return items;
+}
+
+// parse a latency line of the benchmark
+static void parse_latency(const string &line, double lat[3])
+{
+    size_t pos = line.find(" p50 ");
+    if (pos != string::npos)
+        sscanf(line.c_str() + pos, " p50 %lf p99 %lf p99.9 %lf", &lat[0], &lat[1], &lat[2]);
+}
+
+// parse the output of a run
+static void parse_output(const string &output, run_t &run)
+{
+    istringstream in(output);
+    string line;
+    bool has_throughput = false;
+    while (getline(in, line)) {
+        if (line.compare(0, 7, "[Main] ") != 0)
+            continue;
+        const char *rest = line.c_str() + 7;
+        if (sscanf(rest, "Throughput %lf", &run.throughput) == 1)
+            has_throughput = true;
+        else if (sscanf(rest, "Steady-state throughput %lf", &run.steady_throughput) == 1) {}
+        else if (sscanf(rest, "Total elapsed time (seconds) %lf", &run.elapsed_sec) == 1) {}
+        else if (sscanf(rest, "Total generated messages are %lu", &run.generated) == 1) {}
+        else if (sscanf(rest, "Total received results are %lu", &run.results) == 1) {}
+        else if (line.find("Tuple latency") != string::npos)
+            parse_latency(line, run.tuple_lat);
+        else if (line.find("Result latency") != string::npos)
+            parse_latency(line, run.result_lat);
+    }
+    run.ok = run.ok && has_throughput;
+}
+
+// run the benchmark with some arguments collecting its output and its resources
+static run_t execute(const vector<string> &args)
+{
+    run_t run;
+    int fds[2];
+    if (pipe(fds) != 0)
+        return run;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return run;
+    }
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        vector<char *> argv;
+        for (auto &a: args)
+            argv.push_back((char *) a.c_str());
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    close(fds[1]);
+    string output;
+    char chunk[4096];
+    ssize_t n;
+    while ((n = read(fds[0], chunk, sizeof(chunk))) != 0) {
+        if (n > 0)
+            output.append(chunk, n);
+        else if (errno != EINTR)
+            break;
+    }
+    close(fds[0]);
+    int status = 0;
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR) {}
+    run.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    run.cpu_sec = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+    run.peak_rss_kb = usage.ru_maxrss;
+    parse_output(output, run);
+    return run;
+}
+
+// true if the binary is the batched version (the only one accepting -b)
+static bool is_batched(const string &binary)
+{
+    size_t slash = binary.rfind('/');
+    string name = (slash == string::npos) ? binary : binary.substr(slash + 1);
+    return name.find("batched") != string::npos;
+}
+
+// get the arguments of a run of a binary in a configuration (-b only for the batched version)
+static vector<string> run_args(const string &binary, const string &exec_time, const config_t &cfg)
+{
+    vector<string> args = { binary, "-l", exec_time, "-n", cfg.pardegree1, "-m", cfg.pardegree2 };
+    if (!cfg.threads.empty())
+        args.insert(args.end(), { "-t", cfg.threads });
+    if (!cfg.batch_len.empty() && is_batched(binary))
+        args.insert(args.end(), { "-b", cfg.batch_len });
+    if (!cfg.campaigns.empty())
+        args.insert(args.end(), { "-C", cfg.campaigns });
+    for (auto &a: split(cfg.mode, ' '))
+        args.push_back(a);
+    return args;
+}
+
+// read the (wid, cmp_id) keys of the results written in CSV (false if the file cannot be read)
+static bool read_keys(const string &path, set<pair<uint64_t, uint64_t>> &keys, uint64_t &max_wid)
+{
+    ifstream in(path);
+    if (!in)
+        return false;
+    string line;
+    max_wid = 0;
+    while (getline(in, line)) {
+        unsigned long long wid, cmp_id;
+        if (sscanf(line.c_str(), "%llu,%llu", &wid, &cmp_id) != 2)
+            continue;
+        keys.insert(make_pair((uint64_t) wid, (uint64_t) cmp_id));
+        max_wid = ((uint64_t) wid > max_wid) ? wid : max_wid;
+    }
+    return true;
+}
+
+/**
+ *  \brief Function to compare the keys of the results of two binaries
+ *
+ *  This function runs the two binaries in the same configuration writing their
+ *  results in CSV, and compares the (wid, cmp_id) keys of the windows before
+ *  the last one of each run (the events are timed by the wall clock, so the
+ *  last window may be completed by only one of the two runs). It returns false
+ *  and prints the first difference if the keys differ.
+ */
+static bool check_keys(const string &binary, const string &other, const string &exec_time, const config_t &cfg)
+{
+    string paths[2] = { "ysb_harness_keys_1.csv", "ysb_harness_keys_2.csv" };
+    string binaries[2] = { binary, other };
+    set<pair<uint64_t, uint64_t>> keys[2];
+    uint64_t max_wid[2];
+    for (int i=0; i<2; i++) {
+        vector<string> args = run_args(binaries[i], exec_time, cfg);
+        args.insert(args.end(), { "-o", paths[i], "-O", "csv" });
+        run_t run = execute(args);
+        bool ok = run.ok && read_keys(paths[i], keys[i], max_wid[i]);
+        unlink(paths[i].c_str());
+        if (!ok) {
+            cerr << "[Harness] Keys not checked: the run of " << binaries[i] << " failed" << endl;
+            return false;
+        }
+    }
+    uint64_t last = (max_wid[0] < max_wid[1]) ? max_wid[0] : max_wid[1];
+    if (max_wid[0] > last + 1 || max_wid[1] > last + 1) {
+        cerr << "[Harness] Keys differ: last window " << max_wid[0] << " written by " << binary << ", " << max_wid[1] << " by " << other << endl;
+        return false;
+    }
+    size_t compared = 0;
+    for (int i=0; i<2; i++) {
+        for (auto &key: keys[i]) {
+            if (key.first >= last)
+                continue;
+            if (keys[1 - i].count(key) == 0) {
+                cerr << "[Harness] Keys differ: window " << key.first << " of campaign " << key.second << " written by "
+                     << binaries[i] << " but not by " << binaries[1 - i] << endl;
+                return false;
+            }
+            compared += (i == 0);
+        }
+    }
+    if (compared == 0) {
+        cerr << "[Harness] Keys not checked: no window completed by both runs" << endl;
+        return false;
+    }
+    cerr << "[Harness] Keys match: " << compared << " (wid, cmp_id) keys of windows before " << last << " written by both "
+         << binary << " and " << other << endl;
+    return true;
+}
+
+// median of some values
+static double median(vector<double> v)
+{
+    if (v.empty())
+        return 0;
+    sort(v.begin(), v.end());
+    size_t n = v.size();
+    return (n % 2 == 1) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// escape a string for JSON
+static string json_string(const string &s)
+{
+    string out = "\"";
+    for (char c: s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+// main
+int main(int argc, char *argv[])
+{
+    int option = 0;
+    string binary = "./test_ysb_flowgraph_batched";
+    string exec_time = "10";
+    vector<string> pardegree1 = { "1" };
+    vector<string> pardegree2 = { "1" };
+    vector<string> threads = { "" };
+    vector<string> batch_lens = { "" };
+    vector<string> campaigns = { "" };
+    vector<string> modes;
+    size_t reps = 3;
+    size_t warmup = 1;
+    string format = "csv";
+    string report_file;
+    string label;
+    string check_binary;
+    const char *usage = " [-e benchmark binary] [-l execution_seconds] [-n list of par_degree] [-m list of par_degree] [-t list of numTBBThreads] [-b list of batch len] [-C list of campaigns] [-a mode arguments (repeatable)] [-r repetitions] [-w warm-up runs] [-f csv|json] [-o report file] [-L label of the build] [-k binary to compare the result keys with]";
+    while ((option = getopt(argc, argv, "e:l:n:m:t:b:C:a:r:w:f:o:L:k:")) != -1) {
+        switch (option) {
+            case 'e': binary = optarg;
+                break;
+            case 'l': exec_time = optarg;
+                break;
+            case 'n': pardegree1 = split(optarg, ',');
+                break;
+            case 'm': pardegree2 = split(optarg, ',');
+                break;
+            case 't': threads = split(optarg, ',');
+                break;
+            case 'b': batch_lens = split(optarg, ',');
+                break;
+            case 'C': campaigns = split(optarg, ',');
+                break;
+            case 'a': modes.push_back(optarg);
+                break;
+            case 'r': reps = atol(optarg);
+                break;
+            case 'w': warmup = atol(optarg);
+                break;
+            case 'f': format = optarg;
+                break;
+            case 'o': report_file = optarg;
+                break;
+            case 'L': label = optarg;
+                break;
+            case 'k': check_binary = optarg;
+                break;
+            default: {
+                cout << argv[0] << usage << endl;
+                exit(EXIT_SUCCESS);
+            }
+        }
+    }
+    if (modes.empty())
+        modes.push_back("");
+    if (reps == 0 || (format != "csv" && format != "json") || pardegree1.empty() || pardegree2.empty() ||
+        threads.empty() || batch_lens.empty() || campaigns.empty()) {
+        cout << argv[0] << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (access(binary.c_str(), X_OK) != 0 || (!check_binary.empty() && access(check_binary.c_str(), X_OK) != 0)) {
+        cout << "[Harness] Benchmark " << ((access(binary.c_str(), X_OK) != 0) ? binary : check_binary) << " not found" << endl;
+        exit(EXIT_FAILURE);
+    }
+    for (auto &b: batch_lens) {
+        if (!b.empty() && !is_batched(binary)) {
+            cout << "[Harness] Batch lengths (-b) are accepted only by the batched version, " << binary << " does not take -b" << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    // the configurations of the sweep
+    vector<config_t> configs;
+    for (auto &n: pardegree1)
+        for (auto &m: pardegree2)
+            for (auto &t: threads)
+                for (auto &b: batch_lens)
+                    for (auto &c: campaigns)
+                        for (auto &mode: modes)
+                            configs.push_back(config_t{ n, m, t, b, c, mode });
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    ofstream file;
+    if (!report_file.empty()) {
+        file.open(report_file);
+        if (!file) {
+            cout << "[Harness] Cannot create the report " << report_file << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    ostream &out = report_file.empty() ? cout : file;
+    if (format == "csv")
+        out << "label,binary,pardegree1,pardegree2,threads,batch_len,campaigns,mode,runs,failed,throughput_mean,throughput_stdev,"
+               "throughput_min,throughput_max,steady_throughput,tuple_p50,tuple_p99,tuple_p999,result_p50,result_p99,result_p999,"
+               "cpu_cores,cpu_utilization,peak_rss_kb,results" << endl;
+    else
+        out << "[" << endl;
+    unsigned long start_us = current_time_usecs();
+    for (size_t k=0; k<configs.size(); k++) {
+        const config_t &cfg = configs[k];
+        vector<string> args = run_args(binary, exec_time, cfg);
+        if (!check_binary.empty() && !check_keys(binary, check_binary, exec_time, cfg))
+            exit(EXIT_FAILURE);
+        string cmd;
+        for (auto &a: args)
+            cmd += (cmd.empty() ? "" : " ") + a;
+        // warm-up runs are discarded
+        vector<run_t> runs;
+        size_t failed = 0;
+        for (size_t r=0; r<warmup+reps; r++) {
+            run_t run = execute(args);
+            cerr << "[Harness] (" << k + 1 << "/" << configs.size() << ") " << cmd << ((r < warmup) ? " warm-up" : " run")
+                 << " " << ((r < warmup) ? r + 1 : r - warmup + 1) << ": ";
+            if (run.ok)
+                cerr << run.throughput << " events/sec, cpu " << run.cpu_sec / run.elapsed_sec << " cores, peak RSS " << run.peak_rss_kb / 1024 << " MB" << endl;
+            else
+                cerr << "FAILED" << endl;
+            if (r < warmup)
+                continue;
+            if (run.ok)
+                runs.push_back(run);
+            else
+                failed++;
+        }
+        // summary of the configuration
+        double mean = 0, stdev = 0, tmin = 0, tmax = 0, steady = 0, cores = 0, results = 0;
+        long peak_rss = 0;
+        vector<double> lat[6];
+        for (auto &run: runs) {
+            mean += run.throughput / runs.size();
+            steady += run.steady_throughput / runs.size();
+            cores += (run.elapsed_sec > 0) ? run.cpu_sec / run.elapsed_sec / runs.size() : 0;
+            results += (double) run.results / runs.size();
+            tmin = (tmin == 0 || run.throughput < tmin) ? run.throughput : tmin;
+            tmax = (run.throughput > tmax) ? run.throughput : tmax;
+            peak_rss = (run.peak_rss_kb > peak_rss) ? run.peak_rss_kb : peak_rss;
+            for (int j=0; j<3; j++) {
+                lat[j].push_back(run.tuple_lat[j]);
+                lat[3 + j].push_back(run.result_lat[j]);
+            }
+        }
+        for (auto &run: runs)
+            stdev += (run.throughput - mean) * (run.throughput - mean);
+        stdev = (runs.size() > 1) ? sqrt(stdev / (runs.size() - 1)) : 0;
+        double utilization = (num_cpus > 0) ? cores / num_cpus : 0;
+        if (format == "csv") {
+            out << label << "," << binary << "," << cfg.pardegree1 << "," << cfg.pardegree2 << "," << cfg.threads << ","
+                << cfg.batch_len << "," << cfg.campaigns << ",\"" << cfg.mode << "\"," << runs.size() << "," << failed << ","
+                << mean << "," << stdev << "," << tmin << "," << tmax << "," << steady;
+            for (int j=0; j<6; j++)
+                out << "," << median(lat[j]);
+            out << "," << cores << "," << utilization << "," << peak_rss << "," << results << endl;
+        }
+        else {
+            out << "  {\"label\": " << json_string(label) << ", \"binary\": " << json_string(binary)
+                << ", \"pardegree1\": " << json_string(cfg.pardegree1) << ", \"pardegree2\": " << json_string(cfg.pardegree2)
+                << ", \"threads\": " << json_string(cfg.threads) << ", \"batch_len\": " << json_string(cfg.batch_len)
+                << ", \"campaigns\": " << json_string(cfg.campaigns) << ", \"mode\": " << json_string(cfg.mode)
+                << ", \"runs\": " << runs.size() << ", \"failed\": " << failed
+                << ", \"throughput\": {\"mean\": " << mean << ", \"stdev\": " << stdev << ", \"min\": " << tmin << ", \"max\": " << tmax << "}"
+                << ", \"steady_throughput\": " << steady
+                << ", \"tuple_latency_usec\": {\"p50\": " << median(lat[0]) << ", \"p99\": " << median(lat[1]) << ", \"p999\": " << median(lat[2]) << "}"
+                << ", \"result_latency_usec\": {\"p50\": " << median(lat[3]) << ", \"p99\": " << median(lat[4]) << ", \"p999\": " << median(lat[5]) << "}"
+                << ", \"cpu_cores\": " << cores << ", \"cpu_utilization\": " << utilization << ", \"peak_rss_kb\": " << peak_rss
+                << ", \"results\": " << results << "}" << ((k + 1 < configs.size()) ? "," : "") << endl;
+        }
+    }
+    if (format == "json")
+        out << "]" << endl;
+    cerr << "[Harness] " << configs.size() << " configurations run in " << (current_time_usecs() - start_us) / 1000000.0 << " sec" << endl;
+    return 0;
+}
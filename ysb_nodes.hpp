@@ -33,7 +33,21 @@
 #include <sys/time.h>
 #include <functional>
 #include <unordered_map>
+#include <ysb_clock.hpp>
 #include <ysb_common.hpp>
+#include <ysb_allocator.hpp>
+#include <latency_histogram.hpp>
+#include <throughput_sampler.hpp>
+#include <rate_limiter.hpp>
+#include <ad_distribution.hpp>
+#include <spsc_shuffle.hpp>
+#include <numa_placement.hpp>
+#include <key_splitting.hpp>
+#include <window_store.hpp>
+#include <window_spec.hpp>
+#include <combiner.hpp>
+#include <operator_stats.hpp>
+#include <result_output.hpp>
 #include <campaign_generator.hpp>
 
 using namespace std;
@@ -47,63 +61,72 @@ std::atomic<long> sentCounter;
 // global variable: constant for the EOS
 const unsigned long EOS = (unsigned long) -1;
 
-/** 
- *  \brief Function to return the number of microseconds from the epoch
- *  
- *  This function returns the number of microseconds from the epoch using
- *  the clock_gettime() call.
- */ 
-static inline unsigned long current_time_usecs() __attribute__((always_inline));
-static inline unsigned long current_time_usecs()
-{
-    struct timespec t;
-    clock_gettime(CLOCK_REALTIME, &t);
-    return (t.tv_sec)*1000000L + (t.tv_nsec / 1000);
-}
-
 // Source functor
 class YSBSource
 {
 private:
+    static const size_t PUBLISH_EVERY = 1024; // events between two updates of the sampled counter
+
     unsigned long execution_time_sec; // total execution time of the benchmark
     unsigned long **ads_arrays;
-    unsigned int adsPerCampaign; // number of ads per campaign
+    AdSampler sampler; // generator of the ads of the events
     size_t num_sent;
     volatile unsigned long current_time_us;
     unsigned int value;
     bool eos = false;
+    RateLimiter limiter; // pacing of the events (if rate-limited)
 
 public:
     // constructor
-    YSBSource(unsigned long _time_sec, unsigned long **_ads_arrays, unsigned int _adsPerCampaign):
-			  execution_time_sec(_time_sec), ads_arrays(_ads_arrays), adsPerCampaign(_adsPerCampaign), num_sent(0), value(0) {}
+    YSBSource(unsigned long _time_sec, unsigned long **_ads_arrays, const AdSampler &_sampler, const RateProfile &_profile=RateProfile()):
+			  execution_time_sec(_time_sec), ads_arrays(_ads_arrays), sampler(_sampler), num_sent(0), value(0), limiter(_profile) {}
 
     // source function
     bool operator()(event_t *&event)
     {
 		if (eos) return false; // stopping
-	    event = new event_t();
-	    current_time_us = current_time_usecs();
+		OpTimer timer(OP_SOURCE);
+	    event = alloc_tuple<event_t>();
+	    next(*event);
+	    stats_out(OP_SOURCE, 1);
+		return true;
+    }
+
+    // fill the next event (the last one has the EOS timestamp)
+    inline void next(event_t &event)
+    {
+	    current_time_us = now_usecs();
 	    // fill the event's fields
-	    event->ts = current_time_usecs() - start_time_usec;
-	    event->user_id = 0; // not meaningful
-	    event->page_id = 0; // not meaningful
-	    event->ad_id = ads_arrays[(value % 100000) % (N_CAMPAIGNS * adsPerCampaign)][1];
-	    event->ad_type = (value % 100000) % 5;
-	    event->event_type = (value % 100000) % 3;
-	    event->ip = 1; // not meaningful
+	    if (limiter.limited()) {
+	    	// wait for the token and use its intended send time as timestamp
+	    	event.ts = limiter.acquire();
+	    	while (current_time_us - start_time_usec < event.ts)
+	    		current_time_us = now_usecs();
+	    }
+	    else
+	    	event.ts = current_time_us - start_time_usec;
+#if !defined(YSB_COMPACT_TUPLES)
+	    event.user_id = 0; // not meaningful
+	    event.page_id = 0; // not meaningful
+#endif
+	    event.ad_id = ads_arrays[sampler.next()][1];
+	    event.ad_type = (value % 100000) % 5;
+	    event.event_type = (value % 100000) % 3;
+#if !defined(YSB_COMPACT_TUPLES)
+	    event.ip = 1; // not meaningful
+#endif
 	    value++;
 	    num_sent++;
-		//volatile long mytime = current_time_usecs();
-		//while(current_time_usecs() - mytime <= 10);
+	    if (num_sent % PUBLISH_EVERY == 0)
+	    	count_generated(PUBLISH_EVERY);
 	    double elapsed_time_sec = (current_time_us - start_time_usec) / 1000000.0;
 	    if (elapsed_time_sec >= execution_time_sec) {
 	        //cout << "[EventSource] Generated " << num_sent << " events" << endl;
 	        sentCounter.fetch_add(num_sent);
+	        count_generated(num_sent % PUBLISH_EVERY);
 	    	eos = true;
-	    	event->ts = EOS;
+	    	event.ts = EOS;
 		}
-		return true;
     }
 };
 
@@ -119,128 +142,247 @@ public:
 
     // filter function
     void operator()(event_t *event, filter_node_t::output_ports_type &op) {
-        if(event->event_type == event_type || event->ts == EOS) {
+		OpTimer timer(OP_FILTER);
+		stats_in(OP_FILTER, 1);
+        if(pass(*event)) {
+	    	stats_out(OP_FILTER, 1);
 	    	if (!std::get<0>(op).try_put(event)) abort();
 		}
     }
+
+    // check whether an event passes the filter (the EOS always does)
+    inline bool pass(const event_t &event) const {
+        return event.event_type == event_type || event.ts == EOS;
+    }
 };
 
 // Join functor
 class YSBJoin
 {
 private:
-    unordered_map<unsigned long, unsigned int> &map; // hashmap
-    campaign_record *relational_table; // relational table
+    size_t myid; // identifier of the join
+    const JoinIndex &index; // index of the relational table
     vector<window_node_t*> &workers;
+    ShuffleMesh<joined_event_t *> *shuffle; // mesh to the workers (nullptr to use the window nodes)
+    bool combine; // true if the joined events are pre-aggregated per pane and time slice (serial join only)
+    Combiner combiner; // partials of the current pane and time slice (if combine is true)
+
+    // send a joined event to a worker
+    inline void route(size_t dest_w, joined_event_t *out)
+    {
+    	numa_record_traffic(dest_w, 1);
+    	if (shuffle != nullptr)
+    		shuffle->push(myid, dest_w, out);
+    	else if (!workers[dest_w]->try_put(out))
+    		abort();
+    }
+
+    // send a joined event (or a partial of the combiner) to the worker of its campaign
+    inline void route_key(joined_event_t *out)
+    {
+		auto key = std::get<0>(out->getControlFields()); // key
+		size_t hashcode = hash<decltype(key)>()(key); // compute the hashcode of the key
+		// evaluate the routing function
+		size_t n_workers = (shuffle != nullptr) ? shuffle->numConsumers() : workers.size();
+		size_t dest_w = hashcode % n_workers; // routing_func(hashcode, pardegree);
+		// routing the data on the basis of a key value
+		stats_out(OP_JOIN, 1);
+		route(dest_w, out);
+    }
+
+    // ship the partials of the combiner
+    void flush_partials()
+    {
+    	combiner.flush([this] (unsigned long cmp_id, partial_t &p) {
+    		joined_event_t *out = alloc_tuple<joined_event_t>();
+    		out->ts = p.last_ts;
+    		out->ad_id = 0;
+#if !defined(YSB_COMPACT_TUPLES)
+    		out->relational_ad_id = 0;
+#endif
+    		out->cmp_id = cmp_id;
+    		out->count = p.count;
+    		route_key(out);
+    	});
+    }
 
 public:
-    // constructor
-    YSBJoin(vector<window_node_t*> &_workers, unordered_map<unsigned long, unsigned int> &_map, campaign_record *_relational_table):
-			workers(_workers), map(_map), relational_table(_relational_table) {}
+    // constructor (the combiner is enabled if combine_pane is the length of the panes)
+    YSBJoin(size_t _myid, vector<window_node_t*> &_workers, const JoinIndex &_index, ShuffleMesh<joined_event_t *> *_shuffle=nullptr,
+            uint64_t _combine_pane=0, uint64_t _combine_slice=1000):
+			myid(_myid), index(_index), workers(_workers), shuffle(_shuffle), combine(_combine_pane > 0),
+			combiner((_combine_pane > 0) ? _combine_pane : 1, _combine_slice) {}
 
 	// constructor
     YSBJoin(const YSBJoin &other):
-			workers(other.workers), map(other.map), relational_table(other.relational_table) {}
+			myid(other.myid), index(other.index), workers(other.workers), shuffle(other.shuffle), combine(other.combine), combiner(other.combiner) {}
 
     // join function
     continue_msg operator()(event_t *event) {
-		if (event->ts == EOS) {
-	    	for(long i=0; i<workers.size(); ++i) {
-				joined_event_t *out = new joined_event_t();
+    	OpTimer timer(OP_JOIN);
+    	stats_in(OP_JOIN, 1);
+    	join(*event);
+    	// input cleanup
+    	free_tuple(event);
+		return continue_msg();  // keep going on
+    }
+
+    // join an event and route the result (the EOS goes to all the workers)
+    inline void join(const event_t &event) {
+		if (event.ts == EOS) {
+	    	flush_partials();
+	    	combiner.publish();
+	    	size_t n_workers = (shuffle != nullptr) ? shuffle->numConsumers() : workers.size();
+	    	for(size_t i=0; i<n_workers; ++i) {
+				joined_event_t *out = alloc_tuple<joined_event_t>();
 				out->ts = EOS;
-				if (!workers[i]->try_put(out)) abort();
+				route(i, out);
 	    	}
-	    	delete event;
-	    	return continue_msg();
+	    	return;
 		}
-		// check inside the hashmap
-        auto it = map.find(event->ad_id);
-        if (it != map.end()) {
-            joined_event_t *out = new joined_event_t();
-            out->ts = event->ts;
-            out->ad_id = event->ad_id;
-            campaign_record record = relational_table[(*it).second];
-            out->relational_ad_id = record.ad_id;
-            out->cmp_id = record.cmp_id;
+		// check inside the join index
+		unsigned long cmp_id;
+        if (!index.find(event.ad_id, cmp_id))
+        	return;
+        if (combine) {
+        	if (combiner.boundary(event.ts))
+        		flush_partials();
+        	combiner.add(cmp_id, event.ts);
+        }
+        else {
+            joined_event_t *out = alloc_tuple<joined_event_t>();
+            out->ts = event.ts;
+            out->ad_id = event.ad_id;
+#if !defined(YSB_COMPACT_TUPLES)
+            out->relational_ad_id = event.ad_id;
+#endif
+            out->cmp_id = cmp_id;
 	    	// parte eseguita dal KF_Emitter (joined_event_t --> joined_event_t)
-	    	{
-				auto key = std::get<0>(out->getControlFields()); // key
-				size_t hashcode = hash<decltype(key)>()(key); // compute the hashcode of the key
-				// evaluate the routing function
-				size_t dest_w = hashcode % workers.size(); // routing_func(hashcode, pardegree);
-				// routing the data on the basis of a key value 
-				if (!workers[dest_w]->try_put(out)) abort();
-	    	}
-	    	// input cleanup
-	    	delete event;
+	    	route_key(out);
 		}
-		return continue_msg();  // keep going on
     }
 };
 
-// Window operator
+// Fused source, filter and join of a lane (fused mode). Each activation generates
+// a chunk of events and filters and joins them in a tight loop, so only the joined
+// events cross the graph, on the keyed shuffle to the window workers
+class YSBFusedLane
+{
+private:
+    static const size_t CHUNK = 256; // events generated by each activation
+
+    YSBSource source;
+    YSBFilter filter;
+    YSBJoin joiner;
+    bool eos = false;
+
+public:
+    // constructor
+    YSBFusedLane(const YSBSource &_source, const YSBFilter &_filter, const YSBJoin &_joiner):
+                 source(_source), filter(_filter), joiner(_joiner) {}
+
+    // lane function (the event is reused, only the joined events are allocated)
+    bool operator()(continue_msg &)
+    {
+		if (eos) return false; // stopping
+		OpTimer timer(OP_LANE);
+		event_t event;
+		size_t generated = 0, passed = 0;
+		for (size_t i=0; i<CHUNK && !eos; i++) {
+			source.next(event);
+			generated++;
+			eos = (event.ts == EOS);
+			if (filter.pass(event)) {
+				passed++;
+				joiner.join(event);
+			}
+		}
+		stats_out(OP_SOURCE, generated);
+		stats_in(OP_FILTER, generated);
+		stats_out(OP_FILTER, passed);
+		stats_in(OP_JOIN, passed);
+		return true;
+    }
+};
+
+// Window operator (tumbling windows aligned to multiples of their size, like
+// the panes of the combiner, so a partial never straddles two windows)
 class WinAggregate
 {
 private:
     long myid;
     long pardegree1;
-    unordered_map<unsigned long, Window*> hashmap;
+    WindowSpec spec; // kind and parameters of the windows (tumbling or session)
+    FlatStateStore<Window> hashmap; // window of each campaign
     int eos_received = 0;
+    size_t processed = 0;
+
+    // get the id of a window (index of a tumbling window, start time of a session)
+    inline uint64_t window_id(const Window &win) const {
+    	return (spec.kind == WindowSpec::SESSION) ? win.initial_ts : win.initial_ts / spec.size;
+    }
 
 public:
 	// constructor
-    WinAggregate(long _myid, long _pardegree1): myid(_myid), pardegree1(_pardegree1) {}
+    WinAggregate(long _myid, long _pardegree1, const WindowSpec &_spec=WindowSpec()): myid(_myid), pardegree1(_pardegree1), spec(_spec) {}
 
-    // window function
-    void operator()(joined_event_t *in, window_node_t::output_ports_type &op) {
+    // window function (the ports are those of window_node_t, or a tuple with
+    // a reference to the sink when the operator is run by the shuffle)
+    template<typename Ports>
+    void operator()(joined_event_t *in, Ports &op) {
+		OpTimer timer(OP_WINDOW);
 		if (in->ts == EOS) {  // end-of-stream management
 		    if (++eos_received == pardegree1) {
-				for (auto& it: hashmap) {
-				    if (it.second != nullptr) {
-						unsigned long cmp_id = it.first;
-						Window &win = *(it.second);
-						win_result *out = new win_result();
-						assert(out);
-						out->setControlFields(cmp_id, 0, win.last_ts);
-						out->count = win.count;
-						out->lastUpdate = win.last_ts;
-						if (!std::get<0>(op).try_put(out)) abort();
-				    }
-				}
+				hashmap.for_each([this, &op] (unsigned long cmp_id, Window &win) {
+					win_result *out = alloc_tuple<win_result>();
+					assert(out);
+					out->setControlFields(cmp_id, window_id(win), win.last_ts);
+					out->count = win.count;
+					out->lastUpdate = win.last_ts;
+					stats_out(OP_WINDOW, 1);
+					if (!std::get<0>(op).try_put(out)) abort();
+				});
 				// forward EOS
-				win_result *out = new win_result();
+				win_result *out = alloc_tuple<win_result>();
 				assert(out);
 				out->ts = EOS;
 				if (!std::get<0>(op).try_put(out)) abort();
 			}
+			free_tuple(in);
 		    return;
 		}
 		unsigned long cmp_id = in->cmp_id;
 		unsigned long ts = in->ts;
-	    auto it = hashmap.find(cmp_id);
-	    if (it != hashmap.end()) {
-		    Window &win = *(it->second);
-		    if ((ts - win.initial_ts) >= 10000000) {  // <--- 10s
-				win_result *out = new win_result();
+		processed += in->count;
+		stats_in(OP_WINDOW, 1);
+		record_latency(LAT_TUPLE, latency_between(ts, now_usecs() - start_time_usec));
+	    bool inserted;
+	    Window &win = hashmap.get(cmp_id, inserted);
+	    if (!inserted) {
+		    bool closed = (spec.kind == WindowSpec::SESSION) ? (ts > win.last_ts + spec.gap) : (ts / spec.size > win.initial_ts / spec.size);
+		    if (closed) {
+				win_result *out = alloc_tuple<win_result>();
 				assert(out);
-				out->setControlFields(cmp_id, 0, win.last_ts);
+				out->setControlFields(cmp_id, window_id(win), win.last_ts);
 				out->count = win.count;
 				out->lastUpdate = win.last_ts;
+				stats_out(OP_WINDOW, 1);
 				if (!std::get<0>(op).try_put(out)) abort();
 				// reset the window
-				win.set(1, ts, ts);
+				win.set(in->count, ts, ts);
 		    }
 		    else {
-				win.count++;
-				win.last_ts = ts;
+				win.count += in->count;
+				win.last_ts = (ts > win.last_ts) ? ts : win.last_ts;
 		    }
 		}
-		else { 
-		    Window *w = new Window(1, ts, ts);
-		    hashmap[cmp_id] = w;
-		}
-		delete in;
+		else
+		    win.set(in->count, ts, ts);
+		free_tuple(in);
     }
+
+    // get the number of processed tuples
+    size_t processedTuples() { return processed; }
 };
 
 // Sink functor
@@ -248,19 +390,25 @@ class YSBSink
 {
 private:
     size_t received;
+    ResultChannel *output; // channel of the results (nullptr if they are not written)
 
 public:
     // constructor
-    YSBSink(): received(0) {}
+    YSBSink(ResultChannel *_output=nullptr): received(0), output(_output) {}
 
     // sink function
     long operator()(win_result *res) {
+		OpTimer timer(OP_SINK);
 		if (res->ts == EOS) {
-	    	delete res;
+	    	free_tuple(res);
 	    	return 0;
 		}
 		received++;
-		delete res;
+		stats_in(OP_SINK, 1);
+		record_latency(LAT_RESULT, latency_between(res->lastUpdate, now_usecs() - start_time_usec));
+		if (output != nullptr)
+			output->write(res->wid, res->cmp_id, res->lastUpdate, res->count);
+		free_tuple(res);
 		return 0;
     }
 
@@ -26,6 +26,9 @@
 #define YSB_NODES
 
 // include
+#include <map>
+#include <deque>
+#include <algorithm>
 #include <tuple>
 #include <mutex>
 #include <atomic>
@@ -33,7 +36,25 @@
 #include <sys/time.h>
 #include <functional>
 #include <unordered_map>
+#include <ysb_clock.hpp>
 #include <ysb_common.hpp>
+#include <ysb_allocator.hpp>
+#include <filter_kernels.hpp>
+#include <latency_histogram.hpp>
+#include <throughput_sampler.hpp>
+#include <rate_limiter.hpp>
+#include <ad_distribution.hpp>
+#include <spsc_shuffle.hpp>
+#include <numa_placement.hpp>
+#include <key_splitting.hpp>
+#include <window_store.hpp>
+#include <window_spec.hpp>
+#include <adaptive_batching.hpp>
+#include <combiner.hpp>
+#include <operator_stats.hpp>
+#include <checkpoint.hpp>
+#include <result_output.hpp>
+#include <event_log.hpp>
 #include <campaign_generator.hpp>
 
 using namespace std;
@@ -47,19 +68,26 @@ std::atomic<long> sentCounter;
 // global variable: constant for the EOS
 const unsigned long EOS = (unsigned long) -1;
 
-/** 
- *  \brief Function to return the number of microseconds from the epoch
- *  
- *  This function returns the number of microseconds from the epoch using
- *  the clock_gettime() call.
- */ 
-static inline unsigned long current_time_usecs() __attribute__((always_inline));
-static inline unsigned long current_time_usecs()
+// parameters of the events generated by the sources (a checkpoint is resumed only with the same ones)
+struct source_workload_t
 {
-    struct timespec t;
-    clock_gettime(CLOCK_REALTIME, &t);
-    return (t.tv_sec)*1000000L + (t.tv_nsec / 1000);
-}
+    AdDistribution dist;
+    uint64_t num_campaigns;
+    uint64_t ads_per_campaign;
+
+    // constructor
+    source_workload_t(): num_campaigns(0), ads_per_campaign(0) {}
+
+    // constructor
+    source_workload_t(const AdDistribution &_dist, uint64_t _num_campaigns, uint64_t _ads_per_campaign):
+                      dist(_dist), num_campaigns(_num_campaigns), ads_per_campaign(_ads_per_campaign) {}
+
+    bool operator==(const source_workload_t &other) const
+    {
+        return dist.kind == other.dist.kind && dist.skew == other.dist.skew && dist.hot_fraction == other.dist.hot_fraction &&
+               dist.hot_prob == other.dist.hot_prob && num_campaigns == other.num_campaigns && ads_per_campaign == other.ads_per_campaign;
+    }
+};
 
 // Source functor
 class YSBSourceBatched
@@ -67,49 +95,177 @@ class YSBSourceBatched
 private:
     unsigned long execution_time_sec; // total execution time of the benchmark
     unsigned long **ads_arrays;
-    unsigned int adsPerCampaign; // number of ads per campaign
+    AdSampler sampler; // generator of the ads of the events
     size_t num_sent;
     volatile unsigned long current_time_us;
     unsigned int value;
     bool eos = false;
     size_t batch_len;
+    RateLimiter limiter; // pacing of the events (if rate-limited)
+    AdaptiveBatcher *batcher; // controller of the batch length (nullptr for fixed batches)
+    CheckpointStore *store; // store of the checkpoints (nullptr if disabled)
+    size_t myid; // identifier of the source
+    uint64_t next_epoch; // id of the next checkpoint
+    source_workload_t workload; // parameters of the events (saved in the checkpoints)
+
+    // save the offsets of the source in the checkpoint whose barrier follows the batch
+    void snapshot(event_batch_t *batch)
+    {
+		unsigned long start_us = current_time_usecs();
+		batch->checkpoint = next_epoch++;
+		CheckpointBuffer buf;
+		buf.put(workload);
+		buf.put(num_sent);
+		buf.put(value);
+		buf.put(sampler);
+		buf.put(limiter);
+		buf.put(next_epoch);
+		buf.put(batch->watermark);
+		store->save(batch->checkpoint, "source-" + to_string(myid), buf, current_time_usecs() - start_us);
+    }
 
 public:
     // constructor
-    YSBSourceBatched(unsigned long _time_sec, unsigned long **_ads_arrays, unsigned int _adsPerCampaign, size_t _batch_len):
-			  	     execution_time_sec(_time_sec), ads_arrays(_ads_arrays), adsPerCampaign(_adsPerCampaign), num_sent(0), value(0), batch_len(_batch_len) {}
+    YSBSourceBatched(unsigned long _time_sec, unsigned long **_ads_arrays, const AdSampler &_sampler, size_t _batch_len,
+                     const RateProfile &_profile=RateProfile(), AdaptiveBatcher *_batcher=nullptr, CheckpointStore *_store=nullptr, size_t _myid=0,
+                     const source_workload_t &_workload=source_workload_t()):
+			  	     execution_time_sec(_time_sec), ads_arrays(_ads_arrays), sampler(_sampler), num_sent(0), value(0), batch_len(_batch_len),
+			  	     limiter(_profile), batcher(_batcher), store(_store), myid(_myid), next_epoch(1), workload(_workload) {}
+
+    // get the number of generated events
+    size_t sentEvents() const { return num_sent; }
+
+    // restore the offsets saved in a checkpoint, getting the timestamp to resume from and the
+    // workload of the checkpoint (false if not valid, also if the workload is not the same)
+    bool restore(CheckpointBuffer &buf, uint64_t &resume_ts, source_workload_t &saved)
+    {
+		if (!buf.get(saved) || !(saved == workload))
+			return false;
+		return buf.get(num_sent) && buf.get(value) && buf.get(sampler) && buf.get(limiter) && buf.get(next_epoch) && buf.get(resume_ts);
+    }
 
     // source function
-    bool operator()(vector<event_t *> &batch_evs)
+    bool operator()(event_batch_t *&batch)
     {
-    	batch_evs.clear(); // <- important!
 		if (eos)
 			return false; // stopping
-		for (size_t i=0; i<batch_len; i++) {
-		    event_t *event = new event_t();
-		    current_time_us = current_time_usecs();
-		    // fill the event's fields
-		    event->ts = current_time_usecs() - start_time_usec;
-		    event->user_id = 0; // not meaningful
-		    event->page_id = 0; // not meaningful
-		    event->ad_id = ads_arrays[(value % 100000) % (N_CAMPAIGNS * adsPerCampaign)][1];
-		    event->ad_type = (value % 100000) % 5;
-		    event->event_type = (value % 100000) % 3;
-		    event->ip = 1; // not meaningful
+		OpTimer timer(OP_SOURCE);
+		size_t len = (batcher != nullptr) ? batcher->nextLength() : batch_len;
+		batch = alloc_batch<event_batch_t>();
+		batch->reset(len);
+		for (size_t i=0; i<len; i++) {
+		    current_time_us = now_usecs();
+		    // fill the event's fields (user_id, page_id, ad_type and ip are not meaningful)
+		    batch->push_back(limiter.limited() ? limiter.acquire() : current_time_us - start_time_usec,
+		                     ads_arrays[sampler.next()][1],
+		                     (value % 100000) % 3);
 		    value++;
 		    num_sent++;
-		    batch_evs.push_back(event);
+		    // an adaptive batch is flushed when it spans the deadline
+		    if (batcher != nullptr && batch->ts[i] - batch->ts[0] >= batcher->flushDeadline())
+		    	break;
 		}
-		//volatile long mytime = current_time_usecs();
-		//while(current_time_usecs() - mytime <= 10);
+		batch->watermark = batch->ts[batch->size - 1]; // timestamps are non-decreasing
+		if (limiter.limited()) {
+			// the batch leaves when the token of its last event is available
+			while (current_time_us - start_time_usec < batch->watermark)
+				current_time_us = now_usecs();
+		}
+		if (batcher != nullptr)
+			batcher->emit(batch->size, batch->ts[0], batch->watermark);
+		stats_out(OP_SOURCE, batch->size);
+		count_generated(batch->size);
 	    double elapsed_time_sec = (current_time_us - start_time_usec) / 1000000.0;
 	    if (elapsed_time_sec >= execution_time_sec) {
 	        //cout << "[EventSource] Generated " << num_sent << " events" << endl;
 	        sentCounter.fetch_add(num_sent);
 	    	eos = true;
-	    	event_t *event = new event_t();
-	    	event->ts = EOS;
-	    	batch_evs.push_back(event);
+	    	batch->eos = true;
+		}
+		else if (store != nullptr && batch->watermark >= next_epoch * store->interval())
+			snapshot(batch); // one barrier per batch, so every source sends all the barriers in order
+		return true;
+    }
+};
+
+// Replay source functor: streams the events of the blocks of a log assigned to
+// the source (one every num_sources, so that all the sources span the whole
+// recording). The batches point into the mapped log (their own columns are
+// used for the ad ids if the log has other ids, and for the timestamps if the
+// replay is rate-limited, which are then the intended send times)
+class YSBReplaySourceBatched
+{
+private:
+    unsigned long execution_time_sec; // maximum execution time of the benchmark
+    const EventLog &log;
+    size_t num_sources;
+    size_t block; // current block
+    size_t pos; // position in the current block
+    size_t batch_len;
+    size_t num_sent;
+    uint64_t last_wm; // watermark of the last batch (also given to an empty one)
+    bool eos = false;
+    RateLimiter limiter; // pacing of the events (if rate-limited)
+    AdaptiveBatcher *batcher; // controller of the batch length (nullptr for fixed batches)
+
+public:
+    // constructor
+    YSBReplaySourceBatched(unsigned long _time_sec, const EventLog &_log, size_t _myid, size_t _num_sources, size_t _batch_len,
+                           const RateProfile &_profile=RateProfile(), AdaptiveBatcher *_batcher=nullptr):
+                           execution_time_sec(_time_sec), log(_log), num_sources(_num_sources), block(_myid), pos(0),
+                           batch_len(_batch_len), num_sent(0), last_wm(0), limiter(_profile), batcher(_batcher) {}
+
+    // source function
+    bool operator()(event_batch_t *&batch)
+    {
+		if (eos)
+			return false; // stopping
+		OpTimer timer(OP_SOURCE);
+		size_t len = (batcher != nullptr) ? batcher->nextLength() : batch_len;
+		batch = alloc_batch<event_batch_t>();
+		batch->reset(len);
+		size_t n = (block < log.numBlocks()) ? std::min(len, log.blockSize(block) - pos) : 0;
+		if (n > 0) {
+			// the columns of the block are used in place
+			const char *ads = log.adIds(block);
+			if (log.idBytes() == sizeof(ysb_id_t))
+				batch->ad_id = (ysb_id_t *) ads + pos;
+			else if (log.idBytes() == sizeof(uint32_t)) {
+				for (size_t i=0; i<n; i++)
+					batch->ad_id[i] = ((const uint32_t *) ads)[pos + i];
+			}
+			else {
+				for (size_t i=0; i<n; i++)
+					batch->ad_id[i] = ((const uint64_t *) ads)[pos + i];
+			}
+			batch->event_type = (uint32_t *) log.eventTypes(block) + pos;
+			if (limiter.limited()) {
+				for (size_t i=0; i<n; i++)
+					batch->ts[i] = limiter.acquire();
+				// the batch leaves when the token of its last event is available
+				while (now_usecs() - start_time_usec < batch->ts[n - 1]);
+			}
+			else
+				batch->ts = (uint64_t *) log.timestamps(block) + pos;
+			batch->size = n;
+			last_wm = batch->ts[n - 1];
+			pos += n;
+			if (pos == log.blockSize(block)) {
+				block += num_sources;
+				pos = 0;
+			}
+			num_sent += n;
+		}
+		batch->watermark = last_wm; // the empty batch closing the log does not move it back
+		if (batcher != nullptr && n > 0)
+			batcher->emit(n, batch->ts[0], batch->watermark);
+		stats_out(OP_SOURCE, n);
+		count_generated(n);
+		double elapsed_time_sec = (now_usecs() - start_time_usec) / 1000000.0;
+		if (block >= log.numBlocks() || elapsed_time_sec >= execution_time_sec) {
+			sentCounter.fetch_add(num_sent);
+			eos = true;
+			batch->eos = true;
 		}
 		return true;
     }
@@ -120,152 +276,641 @@ class YSBFilterBatched
 {
 private:
     unsigned int event_type; // forward only tuples with event_type
+    filter_kernel_t kernel; // kernel used to fill the selection vector
+    AdaptiveBatcher *batcher; // controller of the source (nullptr for fixed batches)
+    uint64_t last_wm; // watermark of the last forwarded batch
 
 public:
     // constructor
-    YSBFilterBatched(unsigned int _event_type=0): event_type(_event_type) {}
-
-    // filter function
-    void operator()(vector<event_t *> batch_input, filter_node_batched_t::output_ports_type &op) {
-    	vector<event_t *> batch_output;
-    	for (size_t i=0; i<batch_input.size(); i++) {
-    		event_t *event = batch_input[i];
-        	if (event->event_type == event_type || event->ts == EOS) {
-        		batch_output.push_back(event);
-			}
-			else
-				delete event;
+    YSBFilterBatched(unsigned int _event_type=0, filter_isa_t _isa=best_filter_isa(), AdaptiveBatcher *_batcher=nullptr):
+                     event_type(_event_type), kernel(get_filter_kernel(_isa)), batcher(_batcher), last_wm(0) {}
+
+    // filter function (fills the selection vector of the batch). A batch without
+    // selected events is still forwarded if it advances the watermark, otherwise
+    // the windows would wait for the next batch with a selected event
+    void operator()(event_batch_t *batch, filter_node_batched_t::output_ports_type &op) {
+		OpTimer timer(OP_FILTER);
+		batch->sel_size = kernel(batch->event_type, batch->size, event_type, batch->sel);
+		stats_in(OP_FILTER, batch->size);
+		stats_out(OP_FILTER, batch->sel_size);
+		if (batch->sel_size > 0 || batch->eos || batch->checkpoint != 0 || batch->watermark > last_wm) {
+			last_wm = (batch->watermark > last_wm) ? batch->watermark : last_wm;
+			if (!std::get<0>(op).try_put(batch)) abort();
 		}
-		if (batch_output.size() > 0) {
-			if (!std::get<0>(op).try_put(batch_output)) abort();
+		else {
+			if (batcher != nullptr && batch->size > 0)
+				batcher->consume(latency_between(batch->ts[0], now_usecs() - start_time_usec));
+			free_batch(batch);
 		}
     }
 };
 
-// Join functor
+// Join functor (batches of the same source must be joined in order)
 class YSBJoinBatched
 {
 private:
-    unordered_map<unsigned long, unsigned int> &map; // hashmap
-    campaign_record *relational_table; // relational table
+    size_t myid; // identifier of the join
+    const JoinIndex &index; // index of the relational table
     vector<window_node_batched_t *> &workers;
+    ShuffleMesh<joined_batch_t *> *shuffle; // mesh to the workers (nullptr to use the window nodes)
+    size_t split; // number of workers sharing a hot key (1 to disable the splitting)
+    uint64_t wm_interval; // idle workers receive a watermark at least every wm_interval usec
+    vector<uint64_t> last_wm_sent; // last watermark sent to each worker
+    HotKeyDetector detector; // detector of the hot keys (if split > 1)
+    vector<uint64_t> routed; // tuples sent to each worker (if split > 1)
+    vector<joined_batch_t *> batches; // output batches of the current input batch (one per worker)
+    AdaptiveBatcher *batcher; // controller of the source (nullptr for fixed batches)
+    bool combine; // true if the joined events are pre-aggregated per pane and time slice
+    Combiner combiner; // partials of the current pane and time slice (if combine is true)
+
+    // get the worker of a key accounting weight tuples to it
+    inline size_t route(unsigned long cmp_id, size_t n_workers, uint64_t weight)
+    {
+        size_t hashcode = hash<size_t>()(cmp_id); // compute the hashcode of the key
+        // evaluate the routing function
+		size_t dest_w = hashcode % n_workers; // routing_func(hashcode, pardegree);
+		if (split > 1) {
+			// a hot key goes to the least loaded of split workers starting from its home one
+			detector.add(cmp_id);
+			if (detector.isHot(cmp_id)) {
+				size_t home = dest_w;
+				for (size_t j=1; j<split && j<n_workers; j++) {
+					size_t w = (home + j) % n_workers;
+					dest_w = (routed[w] < routed[dest_w]) ? w : dest_w;
+				}
+			}
+			routed[dest_w] += weight;
+		}
+		return dest_w;
+    }
+
+    // get the output batch of a worker (created if needed)
+    inline joined_batch_t *output(size_t w, size_t capacity)
+    {
+		if (batches[w] == nullptr) {
+			batches[w] = alloc_batch<joined_batch_t>();
+			batches[w]->reset(capacity);
+		}
+		return batches[w];
+    }
 
 public:
-    // constructor
-    YSBJoinBatched(vector<window_node_batched_t *> &_workers, unordered_map<unsigned long, unsigned int> &_map, campaign_record *_relational_table):
-				   workers(_workers), map(_map), relational_table(_relational_table) {}
+    // constructor (the combiner is enabled if combine_pane is the length of the panes)
+    YSBJoinBatched(size_t _myid, vector<window_node_batched_t *> &_workers, const JoinIndex &_index,
+                   ShuffleMesh<joined_batch_t *> *_shuffle=nullptr, size_t _split=1, AdaptiveBatcher *_batcher=nullptr,
+                   uint64_t _combine_pane=0, uint64_t _combine_slice=1000, uint64_t _wm_interval=100000):
+				   myid(_myid), index(_index), workers(_workers), shuffle(_shuffle), split(_split), wm_interval(_wm_interval), batcher(_batcher),
+				   combine(_combine_pane > 0), combiner((_combine_pane > 0) ? _combine_pane : 1, _combine_slice) {}
 
 	// constructor
     YSBJoinBatched(const YSBJoinBatched &other):
-				   workers(other.workers), map(other.map), relational_table(other.relational_table) {}
+				   myid(other.myid), index(other.index), workers(other.workers), shuffle(other.shuffle), split(other.split),
+				   wm_interval(other.wm_interval), last_wm_sent(other.last_wm_sent), detector(other.detector), routed(other.routed), batcher(other.batcher),
+				   combine(other.combine), combiner(other.combiner) {}
 
     // join function
-    continue_msg operator()(vector<event_t *> batch_input) {
-    	vector<vector<joined_event_t *>> batches(workers.size());
-    	for (size_t i=0; i<batch_input.size(); i++) {
-    		event_t *event = batch_input[i];
-    		if (event->ts == EOS) {
-    			for (size_t w=0; w<workers.size(); w++) {
-    				joined_event_t *out = new joined_event_t();
-    				out->ts = EOS;
-    				batches[w].push_back(out);
-    			}
-    		}
-    		else {
-	    		// check inside the hashmap
-	        	auto it = map.find(event->ad_id);
-	    		if (it != map.end()) {
-	    			joined_event_t *out = new joined_event_t();
-					out->ts = event->ts;
-	            	out->ad_id = event->ad_id;
-	            	campaign_record record = relational_table[(*it).second];
-	            	out->relational_ad_id = record.ad_id;
-	            	out->cmp_id = record.cmp_id;
-	            	auto key = std::get<0>(out->getControlFields()); // key
-	            	size_t hashcode = hash<decltype(key)>()(key); // compute the hashcode of the key
-	            	// evaluate the routing function
-					size_t dest_w = hashcode % workers.size(); // routing_func(hashcode, pardegree);
-					batches[dest_w].push_back(out);
-				}
-			}
-			delete event;
+    continue_msg operator()(event_batch_t *batch_input) {
+    	OpTimer timer(OP_JOIN);
+    	stats_in(OP_JOIN, batch_input->sel_size);
+    	size_t n_workers = (shuffle != nullptr) ? shuffle->numConsumers() : workers.size();
+    	if (last_wm_sent.size() != n_workers) {
+    		last_wm_sent.assign(n_workers, 0);
+    		routed.assign(n_workers, 0);
+    		detector = HotKeyDetector(n_workers);
     	}
-    	for (size_t w=0; w<workers.size(); w++) {
-    		if (batches[w].size() > 0) {
-    			if (!workers[w]->try_put(batches[w])) abort();
+    	batches.assign(n_workers, nullptr);
+    	// check inside the join index (lookups of the selected events are prefetched)
+    	// the partials of the combiner are shipped in place of the joined events (each
+    	// one is held from a previous batch or contains an event of this batch)
+    	size_t out_capacity = batch_input->sel_size + combiner.size();
+    	auto ship = [&] (unsigned long cmp_id, partial_t &p) {
+    		output(route(cmp_id, n_workers, p.count), out_capacity)->push_back_partial(p.last_ts, cmp_id, p.count);
+    	};
+    	index.find_batch(batch_input->ad_id, batch_input->sel, batch_input->sel_size, [&] (uint32_t i, unsigned long cmp_id) {
+    		if (combine) {
+    			if (combiner.boundary(batch_input->ts[i]))
+    				combiner.flush(ship);
+    			combiner.add(cmp_id, batch_input->ts[i]);
+    			return;
+    		}
+			output(route(cmp_id, n_workers, 1), out_capacity)->push_back(batch_input->ts[i], batch_input->ad_id[i], cmp_id);
+    	});
+    	// (also at the barriers, so that the partials are in the snapshots of the workers)
+    	if (batch_input->eos || batch_input->checkpoint != 0 || combiner.expired(batch_input->watermark))
+    		combiner.flush(ship);
+    	if (batch_input->eos)
+    		combiner.publish();
+    	// the watermark is piggybacked on the data, and sent alone to the
+    	// workers without data if it advanced enough since the last one (it
+    	// does not pass the first event of the partials held by the combiner).
+    	// The barriers of the checkpoints are sent to all the workers
+    	uint64_t watermark = batch_input->watermark;
+    	if (combiner.pending() && combiner.firstTs() < watermark)
+    		watermark = combiner.firstTs();
+    	for (size_t w=0; w<n_workers; w++) {
+    		if (batches[w] == nullptr && (batch_input->eos || batch_input->checkpoint != 0 || (watermark > last_wm_sent[w] && watermark - last_wm_sent[w] >= wm_interval)))
+    			output(w, 0);
+    		if (batches[w] != nullptr) {
+    			batches[w]->src_id = myid;
+    			batches[w]->watermark = watermark;
+    			batches[w]->checkpoint = batch_input->checkpoint;
+    			batches[w]->eos = batch_input->eos;
+    			last_wm_sent[w] = watermark;
     		}
+    	}
+    	if (batcher != nullptr && batch_input->size > 0)
+    		batcher->consume(latency_between(batch_input->ts[0], now_usecs() - start_time_usec));
+    	free_batch(batch_input);
+    	for (size_t w=0; w<n_workers; w++) {
+    		if (batches[w] == nullptr)
+    			continue;
+    		numa_record_traffic(w, batches[w]->size);
+    		stats_out(OP_JOIN, batches[w]->size);
+    		if (shuffle != nullptr)
+    			shuffle->push(myid, w, batches[w]);
+    		else if (!workers[w]->try_put(batches[w]))
+    			abort();
     	}
 		return continue_msg();  // keep going on
     }
+
 };
 
-// Window operator
+// Window operator (event-time tumbling, sliding or session windows fired by the watermarks)
 class WinAggregateBatched
 {
 private:
+    static const size_t PREFETCH_DIST = 8; // distance of the prefetches of the windows in a batch
+
     long myid;
     long pardegree1;
-    unordered_map<unsigned long, vector<Window> *> hashmap;
+    WindowSpec spec; // kind and parameters of the windows
+    uint64_t pane_len; // length of the panes in usec (tumbling and sliding)
+    map<uint64_t, FlatStateStore<Window>> windows; // open panes grouped by pane id
+    FlatStateStore<Window> *cur_windows; // panes with id cur_wid (cache of the last lookup)
+    uint64_t cur_wid;
+    uint64_t pane_floor; // panes ending not later than it have been deleted
+    uint64_t next_win; // id of the next sliding window to fire
+    FlatStateStore<vector<Window>> sessions; // open sessions of each campaign
+    uint64_t next_deadline; // no session can be closed before this time
+    vector<uint64_t> watermarks; // last watermark received from each join
+    uint64_t watermark; // minimum watermark across the joins
     int eos_received = 0;
     size_t received;
+    size_t late;
+    size_t open_windows;
+    size_t max_open_windows;
+    size_t processed;
+    bool partial; // true if the fired windows are partial and sent to the merge
+    uint64_t fired_wid; // windows with smaller id have been fired
+    CheckpointStore *store; // store of the checkpoints (nullptr if disabled)
+    vector<deque<joined_batch_t *>> held; // batches received from each join after its barrier
+    vector<bool> blocked; // true if the barrier of the join has been received
+    size_t num_blocked; // joins whose barrier has been received
+    uint64_t aligned_epoch; // checkpoint whose barriers are being aligned (if num_blocked > 0)
+    size_t num_held; // batches held by the alignment
+    ResultChannel *output; // channel of the results (nullptr if they are not written or partial)
 
-public:
-	// constructor
-    WinAggregateBatched(long _myid, long _pardegree1): myid(_myid), pardegree1(_pardegree1), received(0), avgLatencyUs(0) {}
-
-    // window function
-    void operator()(vector<joined_event_t *> batch_input, window_node_batched_t::output_ports_type &op) {
-    	for (size_t i=0; i<batch_input.size(); i++) {
-    		joined_event_t *event = batch_input[i];
-			if (event->ts == EOS) {  // end-of-stream management
-			    if (++eos_received == pardegree1) {
-					for (auto& it: hashmap) {
-						vector<Window> &wins = *(it.second);
-						received += wins.size();
-					}
+    // send the fired windows to the merge
+    template<typename Ports>
+    static void send_results(Ports &op, win_results_t *out) {
+    	if (!std::get<0>(op).try_put(out)) abort();
+    }
+
+    // no merge when the operator is run by the shuffle without ports
+    static void send_results(std::tuple<> &, win_results_t *out) {
+    	free_batch(out);
+    }
+
+    // emit the result of a window (to the merge if out is not nullptr)
+    inline void emit(win_results_t *out, unsigned long cmp_id, uint64_t wid, const Window &win, uint64_t now) {
+    	stats_out(OP_WINDOW, 1);
+    	if (out != nullptr) {
+    		win_result res;
+    		res.setControlFields(cmp_id, wid, win.last_ts);
+    		res.count = win.count;
+    		res.lastUpdate = win.last_ts;
+    		out->results.push_back(res);
+    	}
+    	else {
+    		record_latency(LAT_RESULT, latency_between(win.last_ts, now));
+    		received++;
+    		if (output != nullptr)
+    			output->write(wid, cmp_id, win.last_ts, win.count);
+    	}
+    }
+
+    // delete the first pane
+    void delete_first_pane() {
+    	open_windows -= windows.begin()->second.size();
+    	if (windows.begin()->first == cur_wid)
+    		cur_windows = nullptr;
+    	windows.erase(windows.begin());
+    }
+
+    // fire the tumbling windows ending not later than wm (all if eos is true)
+    void fire_tumbling(uint64_t wm, bool eos, win_results_t *out, uint64_t now) {
+    	while (!windows.empty() && (eos || (windows.begin()->first + 1) * pane_len <= wm)) {
+    		uint64_t wid = windows.begin()->first;
+    		windows.begin()->second.for_each([&] (unsigned long cmp_id, Window &win) { emit(out, cmp_id, wid, win, now); });
+    		delete_first_pane();
+    	}
+    	pane_floor = wm;
+    }
+
+    // fire the sliding windows ending not later than wm (all if eos is true) merging their panes
+    void fire_sliding(uint64_t wm, bool eos, win_results_t *out, uint64_t now) {
+    	while (!windows.empty()) {
+    		// skip the windows ending before the first pane
+    		uint64_t first_start = windows.begin()->first * pane_len;
+    		if (first_start >= spec.size && next_win <= (first_start - spec.size) / spec.slide)
+    			next_win = (first_start - spec.size) / spec.slide + 1;
+    		uint64_t start = next_win * spec.slide;
+    		uint64_t end = start + spec.size;
+    		if (!eos && end > wm)
+    			break;
+    		FlatStateStore<Window> merged_panes;
+    		for (auto it = windows.lower_bound(start / pane_len); it != windows.end() && it->first < end / pane_len; ++it) {
+    			it->second.for_each([&merged_panes] (unsigned long cmp_id, Window &pane) {
+    				bool inserted;
+    				Window &win = merged_panes.get(cmp_id, inserted);
+    				win.count += pane.count;
+    				win.initial_ts = (pane.initial_ts < win.initial_ts) ? pane.initial_ts : win.initial_ts;
+    				win.last_ts = (pane.last_ts > win.last_ts) ? pane.last_ts : win.last_ts;
+    			});
+    		}
+    		merged_panes.for_each([&] (unsigned long cmp_id, Window &win) { emit(out, cmp_id, next_win, win, now); });
+    		next_win++;
+    		// delete the panes not contained in the next windows
+    		pane_floor = next_win * spec.slide;
+    		while (!windows.empty() && (windows.begin()->first + 1) * pane_len <= pane_floor)
+    			delete_first_pane();
+    	}
+    }
+
+    // fire the sessions whose gap ended before wm (all if eos is true)
+    void fire_sessions(uint64_t wm, bool eos, win_results_t *out, uint64_t now) {
+    	if (!eos && wm <= next_deadline)
+    		return;
+    	next_deadline = (uint64_t) -1;
+    	sessions.for_each([&] (unsigned long cmp_id, vector<Window> &list) {
+    		for (size_t s=0; s<list.size(); ) {
+    			if (eos || list[s].last_ts + spec.gap < wm) {
+    				emit(out, cmp_id, list[s].initial_ts, list[s], now);
+    				list.erase(list.begin() + s);
+    				open_windows--;
+    			}
+    			else {
+    				next_deadline = std::min(next_deadline, list[s].last_ts + spec.gap);
+    				s++;
+    			}
+    		}
+    	});
+    }
+
+    // add an event to the sessions of its campaign, merging those it connects
+    inline void add_to_sessions(vector<Window> &list, uint64_t ts, unsigned long now_us) {
+    	size_t s = 0;
+    	while (s < list.size() && !(ts + spec.gap >= list[s].initial_ts && ts <= list[s].last_ts + spec.gap))
+    		s++;
+    	if (s == list.size()) {
+    		list.push_back(Window(1, ts, ts));
+    		list.back().last_Update = now_us;
+    		open_windows++;
+    		max_open_windows = (open_windows > max_open_windows) ? open_windows : max_open_windows;
+    		next_deadline = std::min(next_deadline, ts + spec.gap);
+    		return;
+    	}
+    	list[s].count++;
+    	list[s].initial_ts = std::min(list[s].initial_ts, ts);
+    	list[s].last_ts = std::max(list[s].last_ts, ts);
+    	list[s].last_Update = now_us;
+    	for (size_t o=0; o<list.size(); ) {
+    		if (o != s && list[o].initial_ts <= list[s].last_ts + spec.gap && list[s].initial_ts <= list[o].last_ts + spec.gap) {
+    			list[s].count += list[o].count;
+    			list[s].initial_ts = std::min(list[s].initial_ts, list[o].initial_ts);
+    			list[s].last_ts = std::max(list[s].last_ts, list[o].last_ts);
+    			list.erase(list.begin() + o);
+    			open_windows--;
+    			s = (o < s) ? s - 1 : s;
+    			o = 0; // the extended session can now reach other sessions
+    		}
+    		else
+    			o++;
+    	}
+    }
+
+    // fire the windows completed by the watermark wm (all if eos is true)
+    template<typename Ports>
+    void fire(uint64_t wm, bool eos, Ports &op) {
+    	uint64_t now = now_usecs() - start_time_usec;
+    	win_results_t *out = nullptr;
+    	if (partial && (eos || wm / pane_len > fired_wid)) {
+    		// the merge is notified of every pane boundary, also without results
+    		out = alloc_batch<win_results_t>();
+    		out->reset();
+    		out->worker = myid;
+    		out->watermark = wm;
+    		out->eos = eos;
+    		fired_wid = wm / pane_len;
+    	}
+    	switch (spec.kind) {
+    		case WindowSpec::SLIDING: fire_sliding(wm, eos, out, now); break;
+    		case WindowSpec::SESSION: fire_sessions(wm, eos, out, now); break;
+    		default: fire_tumbling(wm, eos, out, now);
+    	}
+    	if (out != nullptr)
+    		send_results(op, out);
+    }
+
+    // process a batch of joined events
+    template<typename Ports>
+    void process(joined_batch_t *batch_input, Ports &op) {
+    	OpTimer timer(OP_WINDOW);
+    	stats_in(OP_WINDOW, batch_input->size);
+    	unsigned long now_us = now_usecs(); // one clock read per batch
+    	uint64_t now = now_us - start_time_usec;
+    	LatencyHistogram &tuple_latency = my_latency_histograms()[LAT_TUPLE];
+    	if (spec.kind == WindowSpec::SESSION) {
+    		processed += batch_input->size;
+    		for (size_t i=0; i<batch_input->size; i++) {
+				unsigned long ts = batch_input->ts[i];
+				tuple_latency.record(latency_between(ts, now));
+				if (ts + spec.gap < watermark) { // session already fired
+					late++;
+					continue;
 				}
+				bool inserted;
+				add_to_sessions(sessions.get(batch_input->cmp_id[i], inserted), ts, now_us);
+    		}
+    	}
+    	for (size_t i=0; i<batch_input->size && spec.kind != WindowSpec::SESSION; i++) {
+			unsigned long cmp_id = batch_input->cmp_id[i];
+			unsigned long ts = batch_input->ts[i];
+			uint64_t n = batch_input->combined ? batch_input->count[i] : 1; // events of a partial of the combiner
+			processed += n;
+			tuple_latency.record(latency_between(ts, now));
+			unsigned long wid = ts / pane_len;
+			if ((wid + 1) * pane_len <= pane_floor) { // pane already deleted
+				late += n;
+				continue;
 			}
-		    else {
-				unsigned long cmp_id = event->cmp_id;
-				unsigned long ts = event->ts;
-				unsigned long wid = event->ts / 10000000;
-	    		auto it = hashmap.find(cmp_id);
-				if (it != hashmap.end()) {
-					vector<Window> &wins = *(it->second);
-					if (wins.size() <= wid) {
-						for (size_t i=wins.size(); i<=wid; i++)
-							wins.push_back(Window());
-						wins[wid].count = 1;
-						wins[wid].initial_ts = ts;
-						wins[wid].last_ts = ts;
-						wins[wid].last_Update = current_time_usecs();
-					}
-					else {
-						wins[wid].count++;
-						if (wins[wid].initial_ts > ts)
-							wins[wid].initial_ts = ts;
-						if (wins[wid].last_ts < ts)
-							wins[wid].last_ts = ts;
-						wins[wid].last_Update = current_time_usecs();
-					}
-				}
-				else {
-					vector<Window> *wins = new vector<Window>();
-					for (size_t i=0; i<=wid; i++)
-						wins->push_back(Window());
-					(*wins)[wid].count = 1;
-					(*wins)[wid].initial_ts = ts;
-					(*wins)[wid].last_ts = ts;
-					(*wins)[wid].last_Update = current_time_usecs();
-					hashmap[cmp_id] = wins;
-				}
+			if (cur_windows == nullptr || cur_wid != wid) {
+				cur_windows = &windows[wid];
+				cur_wid = wid;
+			}
+			if (i + PREFETCH_DIST < batch_input->size) // windows of the next events are likely in the same store
+				cur_windows->prefetch(batch_input->cmp_id[i + PREFETCH_DIST]);
+			bool inserted;
+			Window &win = cur_windows->get(cmp_id, inserted);
+			if (inserted) {
+				open_windows++;
+				max_open_windows = (open_windows > max_open_windows) ? open_windows : max_open_windows;
 			}
-			delete event;
+			win.count += n;
+			if (win.initial_ts > ts)
+				win.initial_ts = ts;
+			if (win.last_ts < ts)
+				win.last_ts = ts;
+			win.last_Update = now_us;
 		}
+		// advance the watermark and fire the completed windows
+		if (batch_input->watermark > watermarks[batch_input->src_id])
+			watermarks[batch_input->src_id] = batch_input->watermark;
+		uint64_t min_wm = watermarks[0];
+		for (size_t j=1; j<watermarks.size(); j++)
+			min_wm = (watermarks[j] < min_wm) ? watermarks[j] : min_wm;
+		if (batch_input->eos)  // end-of-stream management
+			eos_received++;
+		if (min_wm > watermark || eos_received == pardegree1) {
+			watermark = min_wm;
+			fire(watermark, eos_received == pardegree1, op);
+		}
+		free_batch(batch_input);
 	}
 
+    // process a batch and its barrier: the join is blocked until the barriers
+    // of all the joins have been received, then the windows are saved
+    template<typename Ports>
+    void deliver(joined_batch_t *batch_input, Ports &op) {
+    	size_t src = batch_input->src_id;
+    	uint64_t epoch = batch_input->checkpoint;
+    	process(batch_input, op);
+    	if (eos_received > 0) { // no checkpoints once a join is over (a pending one is abandoned)
+    		blocked.assign(pardegree1, false);
+    		num_blocked = 0;
+    		return;
+    	}
+    	if (epoch == 0)
+    		return;
+    	// every join sends all the barriers in order, so those aligned together have the same epoch
+    	if (num_blocked == 0)
+    		aligned_epoch = epoch;
+    	else if (epoch != aligned_epoch) {
+    		cerr << "[Checkpoint] Worker " << myid << " received the barrier of checkpoint " << epoch << " from join " << src
+    		     << " while aligning checkpoint " << aligned_epoch << endl;
+    		abort();
+    	}
+    	blocked[src] = true;
+    	if (++num_blocked == (size_t) pardegree1) {
+    		snapshot(epoch);
+    		blocked.assign(pardegree1, false);
+    		num_blocked = 0;
+    	}
+    }
+
+    // process the batches held for the joins not blocked
+    template<typename Ports>
+    void drain(Ports &op) {
+    	bool progress = true;
+    	while (num_held > 0 && progress) {
+    		progress = false;
+    		for (size_t j=0; j<held.size(); j++) {
+    			while (!blocked[j] && !held[j].empty()) {
+    				joined_batch_t *batch_input = held[j].front();
+    				held[j].pop_front();
+    				num_held--;
+    				deliver(batch_input, op);
+    				progress = true;
+    			}
+    		}
+    	}
+    }
+
+    // save a copy of the windows in a checkpoint
+    void snapshot(uint64_t epoch) {
+    	unsigned long start_us = current_time_usecs();
+    	CheckpointBuffer buf;
+    	buf.put(pardegree1);
+    	buf.put(spec);
+    	buf.put(pane_floor);
+    	buf.put(next_win);
+    	buf.put(next_deadline);
+    	buf.put(watermark);
+    	buf.put(fired_wid);
+    	buf.put(received);
+    	buf.put(late);
+    	buf.put(processed);
+    	buf.put(max_open_windows);
+    	for (auto wm: watermarks)
+    		buf.put(wm);
+    	buf.put(windows.size());
+    	for (auto &pane: windows) {
+    		buf.put(pane.first);
+    		buf.put(pane.second.size());
+    		pane.second.for_each([&buf] (unsigned long cmp_id, Window &win) { buf.put(cmp_id); buf.put(win); });
+    	}
+    	buf.put(sessions.size());
+    	sessions.for_each([&buf] (unsigned long cmp_id, vector<Window> &list) {
+    		buf.put(cmp_id);
+    		buf.put(list.size());
+    		for (auto &win: list)
+    			buf.put(win);
+    	});
+    	store->save(epoch, "worker-" + to_string(myid), buf, current_time_usecs() - start_us);
+    }
+
+public:
+	// constructor
+    WinAggregateBatched(long _myid, long _pardegree1, const WindowSpec &_spec=WindowSpec(), bool _partial=false, CheckpointStore *_store=nullptr,
+                        ResultChannel *_output=nullptr):
+    				    myid(_myid), pardegree1(_pardegree1), spec(_spec), pane_len(_spec.pane()), cur_windows(nullptr), cur_wid(0),
+    				    pane_floor(0), next_win(0), next_deadline((uint64_t) -1), watermarks(_pardegree1, 0), watermark(0),
+    				    received(0), late(0), open_windows(0), max_open_windows(0), processed(0), partial(_partial), fired_wid(0),
+    				    store(_store), held(_pardegree1), blocked(_pardegree1, false), num_blocked(0), aligned_epoch(0), num_held(0), output(_output)
+    {
+    	pane_len = (spec.kind == WindowSpec::SESSION) ? spec.gap : pane_len; // pane boundaries notified to the merge
+    }
+
+	// copy constructor
+    WinAggregateBatched(const WinAggregateBatched &other):
+    				    myid(other.myid), pardegree1(other.pardegree1), spec(other.spec), pane_len(other.pane_len), windows(other.windows),
+    				    cur_windows(nullptr), cur_wid(0), pane_floor(other.pane_floor), next_win(other.next_win), sessions(other.sessions),
+    				    next_deadline(other.next_deadline), watermarks(other.watermarks), watermark(other.watermark), eos_received(other.eos_received),
+    				    received(other.received), late(other.late), open_windows(other.open_windows), max_open_windows(other.max_open_windows),
+    				    processed(other.processed), partial(other.partial), fired_wid(other.fired_wid), store(other.store), held(other.held),
+    				    blocked(other.blocked), num_blocked(other.num_blocked), aligned_epoch(other.aligned_epoch), num_held(other.num_held),
+    				    output(other.output) {}
+
+    // window function (the ports are those of window_node_batched_t, or a tuple
+    // with a reference to the merge, possibly empty, when the operator is run by
+    // the shuffle)
+    template<typename Ports>
+    void operator()(joined_batch_t *batch_input, Ports &op) {
+    	if (blocked[batch_input->src_id]) { // received after the barrier of its join
+    		held[batch_input->src_id].push_back(batch_input);
+    		num_held++;
+    		return;
+    	}
+    	deliver(batch_input, op);
+    	drain(op);
+    }
+
+    // restore the windows saved in a checkpoint (false if not valid for this operator)
+    bool restore(CheckpointBuffer &buf) {
+    	long p1;
+    	WindowSpec s;
+    	if (!buf.get(p1) || !buf.get(s) || p1 != pardegree1 || s.kind != spec.kind || s.size != spec.size || s.slide != spec.slide || s.gap != spec.gap)
+    		return false;
+    	bool ok = buf.get(pane_floor) && buf.get(next_win) && buf.get(next_deadline) && buf.get(watermark) && buf.get(fired_wid)
+    	          && buf.get(received) && buf.get(late) && buf.get(processed) && buf.get(max_open_windows);
+    	for (size_t j=0; j<watermarks.size() && ok; j++)
+    		ok = buf.get(watermarks[j]);
+    	size_t num_panes = 0, num_keys = 0;
+    	ok = ok && buf.get(num_panes);
+    	for (size_t p=0; p<num_panes && ok; p++) {
+    		uint64_t wid;
+    		ok = buf.get(wid) && buf.get(num_keys);
+    		for (size_t k=0; k<num_keys && ok; k++) {
+    			unsigned long cmp_id;
+    			bool inserted;
+    			ok = buf.get(cmp_id) && buf.get(windows[wid].get(cmp_id, inserted));
+    			open_windows++;
+    		}
+    	}
+    	ok = ok && buf.get(num_keys);
+    	for (size_t k=0; k<num_keys && ok; k++) {
+    		unsigned long cmp_id;
+    		size_t n = 0;
+    		bool inserted;
+    		if (!buf.get(cmp_id) || !buf.get(n))
+    			return false;
+    		vector<Window> &list = sessions.get(cmp_id, inserted);
+    		list.resize(n);
+    		open_windows += n;
+    		for (size_t i=0; i<n && ok; i++)
+    			ok = buf.get(list[i]);
+    	}
+    	return ok;
+    }
+
     // get the number of received results
     size_t rcvResults() { return received; } 
+
+    // get the number of events dropped because their window was already fired
+    size_t lateEvents() { return late; }
+
+    // get the maximum number of windows (panes for sliding windows) open at the same time
+    size_t maxOpenWindows() { return max_open_windows; }
+
+    // get the number of processed tuples
+    size_t processedTuples() { return processed; }
+};
+
+// Merge of the partial windows fired by the window workers (hot keys split)
+class WinMergeBatched
+{
+private:
+    size_t pardegree2;
+    WindowSpec spec; // kind and parameters of the windows (tumbling or sliding)
+    map<uint64_t, FlatStateStore<Window>> windows; // partially merged windows grouped by window id
+    vector<uint64_t> watermarks; // last watermark received from each worker
+    size_t eos_received;
+    size_t received;
+    size_t merged;
+    ResultChannel *output; // channel of the results (nullptr if they are not written)
+
+public:
+    // constructor
+    WinMergeBatched(size_t _pardegree2, const WindowSpec &_spec=WindowSpec(), ResultChannel *_output=nullptr):
+                    pardegree2(_pardegree2), spec(_spec), watermarks(_pardegree2, 0), eos_received(0), received(0), merged(0), output(_output) {}
+
+    // merge function (a window is complete when all the workers fired it)
+    continue_msg operator()(win_results_t *in) {
+    	OpTimer timer(OP_SINK);
+    	stats_in(OP_SINK, in->results.size());
+    	for (auto &res: in->results) {
+    		bool inserted;
+    		Window &win = windows[res.wid].get(res.cmp_id, inserted);
+    		merged += !inserted;
+    		win.count += res.count;
+    		win.last_ts = (res.lastUpdate > win.last_ts) ? res.lastUpdate : win.last_ts;
+    	}
+    	if (in->watermark > watermarks[in->worker])
+    		watermarks[in->worker] = in->watermark;
+    	if (in->eos)
+    		eos_received++;
+    	uint64_t min_wm = *std::min_element(watermarks.begin(), watermarks.end());
+    	uint64_t now = now_usecs() - start_time_usec;
+    	while (!windows.empty() && (eos_received == pardegree2 || spec.window_end(windows.begin()->first) <= min_wm)) {
+    		uint64_t wid = windows.begin()->first;
+    		windows.begin()->second.for_each([this, now, wid] (unsigned long cmp_id, Window &win) {
+    			record_latency(LAT_RESULT, latency_between(win.last_ts, now));
+    			if (output != nullptr)
+    				output->write(wid, cmp_id, win.last_ts, win.count);
+    		});
+    		received += windows.begin()->second.size();
+    		windows.erase(windows.begin());
+    	}
+    	free_batch(in);
+    	return continue_msg();
+    }
+
+    // get the number of received results
+    size_t rcvResults() { return received; }
+
+    // get the number of partial windows merged into another one
+    size_t mergedWindows() { return merged; }
 };
 
 #endif